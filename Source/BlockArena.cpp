@@ -0,0 +1,145 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2025 VIB Haesler lab
+ Developed by Marine Guyot - CodingResearcher
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "BlockArena.h"
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    constexpr size_t hugePageSize = size_t (2) << 20; // 2 MB
+
+    size_t roundUp (size_t value, size_t multiple) { return ((value + multiple - 1) / multiple) * multiple; }
+}
+
+void BlockArena::allocate (size_t numBytes, bool useHugePages)
+{
+    release();
+
+    if (numBytes == 0)
+        return;
+
+#ifdef WIN32
+    if (useHugePages)
+    {
+        // Needs the "Lock pages in memory" privilege, otherwise fall back to normal pages
+        SIZE_T largePage = GetLargePageMinimum();
+        if (largePage > 0)
+        {
+            size_t bytes = roundUp (numBytes, largePage);
+            data_ = VirtualAlloc (nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (data_ != nullptr)
+            {
+                size_ = bytes;
+                pageType_ = PageType::ExplicitHuge;
+                return;
+            }
+        }
+    }
+
+    size_t bytes = roundUp (numBytes, 4096);
+    data_ = VirtualAlloc (nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (data_ != nullptr)
+    {
+        size_ = bytes;
+        pageType_ = PageType::Normal;
+    }
+#else
+    if (useHugePages)
+    {
+        size_t bytes = roundUp (numBytes, hugePageSize);
+
+#ifdef MAP_HUGETLB
+        // Explicit huge pages, only available if the system reserved some (vm.nr_hugepages)
+        void* ptr = mmap (nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            data_ = ptr;
+            size_ = bytes;
+            pageType_ = PageType::ExplicitHuge;
+            return;
+        }
+#endif
+
+        ptr = mmap (nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            data_ = ptr;
+            size_ = bytes;
+            pageType_ = PageType::Normal;
+
+#ifdef MADV_HUGEPAGE
+            if (madvise (ptr, bytes, MADV_HUGEPAGE) == 0)
+                pageType_ = PageType::TransparentHuge;
+#endif
+            return;
+        }
+    }
+
+    size_t bytes = roundUp (numBytes, 4096);
+    void* ptr = mmap (nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr != MAP_FAILED)
+    {
+        data_ = ptr;
+        size_ = bytes;
+        pageType_ = PageType::Normal;
+    }
+#endif
+}
+
+void BlockArena::release()
+{
+    if (data_ != nullptr)
+    {
+#ifdef WIN32
+        VirtualFree (data_, 0, MEM_RELEASE);
+#else
+        munmap (data_, size_);
+#endif
+    }
+
+    data_ = nullptr;
+    size_ = 0;
+    used_ = 0;
+    pageType_ = PageType::None;
+}
+
+String BlockArena::getPageTypeName() const
+{
+    switch (pageType_)
+    {
+        case PageType::ExplicitHuge:
+            return "explicit huge pages";
+        case PageType::TransparentHuge:
+            return "transparent huge pages";
+        case PageType::Normal:
+            return "normal pages";
+        default:
+            return "not allocated";
+    }
+}
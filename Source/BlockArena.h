@@ -0,0 +1,92 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2025 VIB Haesler lab
+ Developed by Marine Guyot - CodingResearcher
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef BLOCKARENA_H_DEFINED
+#define BLOCKARENA_H_DEFINED
+
+#include <DataThreadHeaders.h>
+
+/**
+    One contiguous allocation holding all the per-block acquisition buffers.
+
+    The arena is reserved once per acquisition, preferably on huge pages so that
+    the strided demux does not thrash the TLB, and handed out in 64-byte aligned
+    slots. Slots are never freed individually: the whole arena is released at once.
+*/
+class BlockArena
+{
+public:
+    static constexpr size_t slotAlignment = 64;
+
+    enum class PageType
+    {
+        None,
+        ExplicitHuge, // MAP_HUGETLB / MEM_LARGE_PAGES
+        TransparentHuge, // MADV_HUGEPAGE
+        Normal
+    };
+
+    BlockArena() = default;
+    ~BlockArena() { release(); }
+
+    BlockArena (const BlockArena&) = delete;
+    BlockArena& operator= (const BlockArena&) = delete;
+
+    /** Reserves at least numBytes, releasing any previous region */
+    void allocate (size_t numBytes, bool useHugePages);
+    void release();
+
+    /** Carves the next aligned slot of count elements, or nullptr if the arena is full */
+    template <typename T>
+    T* carve (size_t count)
+    {
+        size_t offset = alignUp (used_);
+        size_t bytes = count * sizeof (T);
+
+        if (data_ == nullptr || offset + bytes > size_)
+            return nullptr;
+
+        used_ = offset + bytes;
+        return reinterpret_cast<T*> (static_cast<char*> (data_) + offset);
+    }
+
+    /** Bytes needed for a slot of count elements, including alignment padding */
+    template <typename T>
+    static size_t slotSize (size_t count) { return alignUp (count * sizeof (T)); }
+
+    void* getData() const { return data_; }
+    size_t getSize() const { return size_; }
+    PageType getPageType() const { return pageType_; }
+    String getPageTypeName() const;
+
+private:
+    static size_t alignUp (size_t value) { return (value + slotAlignment - 1) & ~(slotAlignment - 1); }
+
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    size_t used_ = 0;
+    PageType pageType_ = PageType::None;
+};
+
+#endif
@@ -2,18 +2,103 @@
 
 #include <juce_core/juce_core.h>
 #include <map>
+#include <set>
+#include <vector>
 
 // ---------------------------------------------------
 // Structs
 // ---------------------------------------------------
 
+/** Offset (volts) and gain of one probe cell: published value = (measured - offset) * gain */
+struct CellCalibration
+{
+    int column = 0;
+    int row = 0; // probe row
+    float offset = 0;
+    float gain = 1;
+
+    bool operator== (const CellCalibration& other) const
+    {
+        return column == other.column && row == other.row && offset == other.offset && gain == other.gain;
+    }
+};
+
+/** Settling calibration of one column module, valid for the scan geometry and dwell it was measured on */
+struct SettlingRecord
+{
+    int module = 0;
+    int lines = 0; // AI lines of the module
+    int rows = 0; // scanned rows
+    int dwell = 0; // shortest row dwell, in samples of the module
+    float tolerance_mv = 0;
+    int discardSamples = 0;
+    double residualEnergy = 0; // V^2
+
+    bool hasSameKey (const SettlingRecord& other) const
+    {
+        return module == other.module && lines == other.lines && rows == other.rows && dwell == other.dwell
+               && tolerance_mv == other.tolerance_mv;
+    }
+
+    bool operator== (const SettlingRecord& other) const
+    {
+        return hasSameKey (other) && discardSamples == other.discardSamples && residualEnergy == other.residualEnergy;
+    }
+};
+
 struct NeuroLayerSystemConfig
 {
+    juce::String name = "NeuroLayer"; // data stream name, one stream per probe system
     // Map each module -> list of lines
     std::map<juce::String, juce::StringArray> columns ={}; // e.g. "PXI2" -> {"line0", "line1"}
     std::map<juce::String, juce::String> rows ={};    // e.g. "PXI2" -> {"Port0"}
-    int numRows; // number of lines used in the digital Port
+    int numRows = 0; // number of lines used in the digital Port
+    int oversampling = 1; // ADC samples averaged per row dwell, divides the frame rate
+    juce::String module_rates = "shared"; // "shared" (one clock) or "per_group" (modules with fewer lines run faster)
+    juce::Array<int> roi_rows = {}; // probe rows to scan (station * numRows + line), empty = all rows
+    std::vector<std::pair<int, int>> scan_sequence = {}; // (probe row, dwell weight) per scan step, replaces roi_rows when set
+    juce::Array<juce::Array<int>> roi_sets = {}; // alternative row sets of the same size, switchable during acquisition
+    int roi_event_label = 62; // TTL line marking the first frame after a row set switch
+    juce::String row_scan_memory = "host"; // "host" (driver regenerates from the PC buffer) or "onboard" (device FIFO)
+    juce::String stream_split = "none"; // "none" (one DataStream) or "module" (one DataStream per column module)
+    juce::Array<juce::StringArray> stream_groups = {}; // column modules published together, replaces stream_split when set
+
+    // Output channel order: "column_major", "row_major" or "probe_map"
+    juce::String channel_order = "column_major";
+    juce::String probe_map_file = ""; // one "column,row" per output channel, used with "probe_map"
+    std::vector<std::pair<int, int>> probe_map = {}; // loaded from probe_map_file
+
+    // Per-cell calibration, applied by the demux kernels
+    juce::String calibration_file = ""; // one "column,row,offset,gain" per probe cell
+    std::vector<CellCalibration> calibration = {}; // loaded from calibration_file
+    std::vector<SettlingRecord> settling_calibration = {}; // loaded from getSettlingFile()
+    juce::String calibration_mode = "apply"; // "apply" the table, or "capture" the offsets at the start of each acquisition
+    int calibration_capture_ms = 1000; // baseline averaged by "capture"
+
+    // Spatial stages, applied to the demuxed frames
+    juce::String reference = "none"; // "none", "car" (all cells), "module_car" (per column module) or "row_median"
+    juce::String row_noise = "none"; // row fixed-pattern removal: "none", "mean" or "median" of each row's cells
+    bool row_noise_stream = false; // publish the removed row signal as its own stream
+    juce::String spatial_filter = "none"; // "none" or "laplacian" (5-point stencil over the probe grid)
+    std::vector<float> laplacian_weights = { 1.0f, -0.25f, -0.25f }; // center, left/right column, upper/lower row
+    std::vector<std::pair<int, int>> bad_cells = {}; // (column, probe row) left out of the spatial stages
 
+    bool operator== (const NeuroLayerSystemConfig& other) const
+    {
+        return name == other.name && columns == other.columns && rows == other.rows && numRows == other.numRows
+               && oversampling == other.oversampling && module_rates == other.module_rates && roi_rows == other.roi_rows
+               && scan_sequence == other.scan_sequence && roi_sets == other.roi_sets
+               && roi_event_label == other.roi_event_label && row_scan_memory == other.row_scan_memory
+               && stream_split == other.stream_split && stream_groups == other.stream_groups
+               && channel_order == other.channel_order && probe_map == other.probe_map
+               && calibration_file == other.calibration_file && calibration == other.calibration
+               && settling_calibration == other.settling_calibration
+               && calibration_mode == other.calibration_mode && calibration_capture_ms == other.calibration_capture_ms
+               && reference == other.reference && row_noise == other.row_noise
+               && row_noise_stream == other.row_noise_stream && spatial_filter == other.spatial_filter
+               && laplacian_weights == other.laplacian_weights && bad_cells == other.bad_cells;
+    }
+    bool operator!= (const NeuroLayerSystemConfig& other) const { return ! (*this == other); }
 };
 
 struct StartEventOutputConfig
@@ -23,6 +108,17 @@ struct StartEventOutputConfig
     float pulse_duration = 0;
     juce::String name = "";
     juce::String digital_line ="";
+    juce::String counter = ""; // counter generating the pulses ("ctr0"), empty writes them as a DO waveform
+    juce::String pulse_terminal = ""; // output terminal of the counter ("PFI4"), empty keeps its default
+
+    bool operator== (const StartEventOutputConfig& other) const
+    {
+        return start_time == other.start_time && nbr_pulse == other.nbr_pulse
+               && pulse_duration == other.pulse_duration && name == other.name
+               && digital_line == other.digital_line && counter == other.counter
+               && pulse_terminal == other.pulse_terminal;
+    }
+    bool operator!= (const StartEventOutputConfig& other) const { return ! (*this == other); }
 };
 
 struct EventInputConfig
@@ -30,25 +126,511 @@ struct EventInputConfig
     juce::String name ="";
     juce::String digital_line = "";
     int oe_event_label = 0;
+
+    bool operator== (const EventInputConfig& other) const
+    {
+        return name == other.name && digital_line == other.digital_line && oe_event_label == other.oe_event_label;
+    }
+    bool operator!= (const EventInputConfig& other) const { return ! (*this == other); }
+};
+
+struct RealtimeConfig
+{
+    juce::String thread_priority = "normal"; // "normal", "high" or "realtime"
+    int rt_priority = 80; // SCHED_FIFO priority used on Linux for "realtime"
+    juce::Array<int> cpu_affinity = {}; // CPUs the acquisition thread may run on, empty = any
+    bool lock_memory = false; // lock the acquisition buffers in RAM
+    bool huge_pages = true; // back the acquisition buffers with huge pages when available
+
+    bool operator== (const RealtimeConfig& other) const
+    {
+        return thread_priority == other.thread_priority && rt_priority == other.rt_priority
+               && cpu_affinity == other.cpu_affinity && lock_memory == other.lock_memory
+               && huge_pages == other.huge_pages;
+    }
+    bool operator!= (const RealtimeConfig& other) const { return ! (*this == other); }
+};
+
+struct DataBufferConfig
+{
+    float headroom_ms = 1000; // how long downstream may fall behind before frames are dropped
+    juce::String overrun_policy = "block"; // "block", "drop_oldest" or "drop_newest"
+    int overrun_event_label = 63; // TTL line marking the first frame after a gap
+
+    bool operator== (const DataBufferConfig& other) const
+    {
+        return headroom_ms == other.headroom_ms && overrun_policy == other.overrun_policy
+               && overrun_event_label == other.overrun_event_label;
+    }
+    bool operator!= (const DataBufferConfig& other) const { return ! (*this == other); }
+};
+
+struct AcquisitionConfig
+{
+    juce::String mode = "thread"; // "thread" (dedicated NeuroProcessor thread) or "update_buffer" (DataThread::updateBuffer)
+
+    bool operator== (const AcquisitionConfig& other) const { return mode == other.mode; }
+    bool operator!= (const AcquisitionConfig& other) const { return ! (*this == other); }
+};
+
+struct SettlingConfig
+{
+    juce::String mode = "off"; // "off", "fixed" (discard_samples) or "auto" (calibrated at startup)
+    int discard_samples = 0; // samples dropped at the start of each row dwell in "fixed" mode
+    float tolerance_mv = 0.5f; // RMS deviation from the settled value accepted by the calibration
+    bool recalibrate = false; // measure at every start, even when a stored calibration matches
+
+    bool operator== (const SettlingConfig& other) const
+    {
+        return mode == other.mode && discard_samples == other.discard_samples && tolerance_mv == other.tolerance_mv
+               && recalibrate == other.recalibrate;
+    }
+    bool operator!= (const SettlingConfig& other) const { return ! (*this == other); }
+};
+
+struct PerformanceConfig
+{
+    float input_buffer_ms = 0; // driver input buffer of the AI and event tasks, 0 keeps the size derived from the block
+    juce::String transfer_mechanism = "default"; // "default", "dma", "interrupts", "programmed_io" or "usb_bulk"
+    juce::String request_condition = "default"; // "default", "not_empty" or "more_than_half_full"
+    juce::String read_wait_mode = "default"; // "default", "wait_for_interrupt", "poll", "yield" or "sleep"
+
+    bool operator== (const PerformanceConfig& other) const
+    {
+        return input_buffer_ms == other.input_buffer_ms && transfer_mechanism == other.transfer_mechanism
+               && request_condition == other.request_condition && read_wait_mode == other.read_wait_mode;
+    }
+    bool operator!= (const PerformanceConfig& other) const { return ! (*this == other); }
+};
+
+struct ChassisConfig
+{
+    juce::String mode = "standalone"; // "standalone", "master" (exports its clocks to another chassis) or "slave" (imports them)
+    juce::String ref_clock_terminal = ""; // PFI of the first AI module carrying the 10 MHz reference, e.g. "PFI3"
+    juce::String start_terminal = ""; // PFI of the first AI module carrying the start trigger, e.g. "PFI4"
+    int sync_event_label = -1; // event input receiving the pulse shared by all chassis, -1 disables the drift check
+    float sync_period_s = 1.0f; // nominal period of the shared pulse
+    int sync_tolerance_frames = 1; // offset from the nominal pulse timing reported as a loss of alignment
+
+    bool operator== (const ChassisConfig& other) const
+    {
+        return mode == other.mode && ref_clock_terminal == other.ref_clock_terminal
+               && start_terminal == other.start_terminal && sync_event_label == other.sync_event_label
+               && sync_period_s == other.sync_period_s && sync_tolerance_frames == other.sync_tolerance_frames;
+    }
+    bool operator!= (const ChassisConfig& other) const { return ! (*this == other); }
 };
 
 struct NeuroConfig
 {
     NeuroLayerSystemConfig neuroLayerSystem;
+    juce::Array<NeuroLayerSystemConfig> additionalSystems = {}; // further probes clocked by the first system
     StartEventOutputConfig startEventOutput;
     juce::Array<EventInputConfig> eventInputs = {};
+    RealtimeConfig realtime;
+    DataBufferConfig dataBuffer;
+    AcquisitionConfig acquisition;
+    SettlingConfig settling;
+    PerformanceConfig performance;
+    ChassisConfig chassis;
+
+    bool operator== (const NeuroConfig& other) const
+    {
+        return neuroLayerSystem == other.neuroLayerSystem && additionalSystems == other.additionalSystems
+               && startEventOutput == other.startEventOutput
+               && eventInputs == other.eventInputs && realtime == other.realtime
+               && dataBuffer == other.dataBuffer && acquisition == other.acquisition
+               && settling == other.settling && performance == other.performance
+               && chassis == other.chassis;
+    }
+    bool operator!= (const NeuroConfig& other) const { return ! (*this == other); }
 };
 
 // ---------------------------------------------------
 // Parsing function
 // ---------------------------------------------------
 
+/** Reads a probe map: one output channel per line, as "column,row" (or whitespace separated).
+    Empty lines and lines starting with '#' are ignored. */
+inline bool loadProbeMap (const File& mapFile, std::vector<std::pair<int, int>>& probeMap)
+{
+    probeMap.clear();
+
+    if (! mapFile.existsAsFile())
+    {
+        LOGE("Probe map file not found: " + mapFile.getFullPathName());
+        return false;
+    }
+
+    StringArray lines;
+    mapFile.readLines (lines);
+
+    for (auto& line : lines)
+    {
+        auto trimmed = line.trim();
+        if (trimmed.isEmpty() || trimmed.startsWith ("#"))
+            continue;
+
+        auto tokens = StringArray::fromTokens (trimmed, ", \t;", "");
+        tokens.removeEmptyStrings();
+
+        if (tokens.size() < 2)
+        {
+            LOGE("Invalid probe map line: " + line);
+            probeMap.clear();
+            return false;
+        }
+
+        probeMap.emplace_back (tokens[0].getIntValue(), tokens[1].getIntValue());
+    }
+
+    return true;
+}
+
+/** Reads a calibration table: one probe cell per line, as "column,row,offset,gain" (or whitespace
+    separated, gain defaults to 1). Empty lines and lines starting with '#' are ignored.
+    Settling lines, "settling,module,lines,rows,dwell,tolerance_mv,discard,residual", go to settling. */
+inline bool loadCalibration (const File& calibrationFile, std::vector<CellCalibration>& calibration,
+                             std::vector<SettlingRecord>* settling = nullptr)
+{
+    calibration.clear();
+    if (settling != nullptr)
+        settling->clear();
+
+    if (! calibrationFile.existsAsFile())
+    {
+        LOGE("Calibration file not found: " + calibrationFile.getFullPathName());
+        return false;
+    }
+
+    StringArray lines;
+    calibrationFile.readLines (lines);
+
+    for (auto& line : lines)
+    {
+        auto trimmed = line.trim();
+        if (trimmed.isEmpty() || trimmed.startsWith ("#"))
+            continue;
+
+        auto tokens = StringArray::fromTokens (trimmed, ", \t;", "");
+        tokens.removeEmptyStrings();
+
+        if (tokens[0] == "settling")
+        {
+            if (tokens.size() < 8)
+            {
+                LOGE("Invalid settling calibration line: " + line);
+                continue;
+            }
+
+            if (settling != nullptr)
+            {
+                SettlingRecord record;
+                record.module = tokens[1].getIntValue();
+                record.lines = tokens[2].getIntValue();
+                record.rows = tokens[3].getIntValue();
+                record.dwell = tokens[4].getIntValue();
+                record.tolerance_mv = tokens[5].getFloatValue();
+                record.discardSamples = tokens[6].getIntValue();
+                record.residualEnergy = tokens[7].getDoubleValue();
+                settling->push_back (record);
+            }
+            continue;
+        }
+
+        if (tokens.size() < 3)
+        {
+            LOGE("Invalid calibration line: " + line);
+            calibration.clear();
+            return false;
+        }
+
+        CellCalibration cell;
+        cell.column = tokens[0].getIntValue();
+        cell.row = tokens[1].getIntValue();
+        cell.offset = tokens[2].getFloatValue();
+        cell.gain = tokens.size() > 3 ? tokens[3].getFloatValue() : 1.0f;
+        calibration.push_back (cell);
+    }
+
+    return true;
+}
+
+/** Writes a calibration table in the format read by loadCalibration */
+inline bool saveCalibration (const File& calibrationFile, const std::vector<CellCalibration>& calibration,
+                             const std::vector<SettlingRecord>& settling = {})
+{
+    String text = "# column,row,offset (V),gain\n";
+    for (const auto& cell : calibration)
+        text += String (cell.column) + "," + String (cell.row) + "," + String (cell.offset, 9) + "," + String (cell.gain, 6) + "\n";
+
+    if (! settling.empty())
+        text += "# settling,module,lines,rows,dwell,tolerance (mV),discard,residual (V^2)\n";
+    for (const auto& record : settling)
+        text += "settling," + String (record.module) + "," + String (record.lines) + "," + String (record.rows) + ","
+                + String (record.dwell) + "," + String (record.tolerance_mv, 6) + "," + String (record.discardSamples) + ","
+                + String (record.residualEnergy, 15) + "\n";
+
+    if (! calibrationFile.replaceWithText (text))
+    {
+        LOGE("Failed to write the calibration file: " + calibrationFile.getFullPathName());
+        return false;
+    }
+
+    return true;
+}
+
+/** File holding the stored settling calibration of a system: the calibration file itself in "capture"
+    mode, where the plugin writes it anyway, and a "_settling" file next to it otherwise, so that a
+    hand-written table is never rewritten. Empty without a calibration file. */
+inline File getSettlingFile (const NeuroLayerSystemConfig& system)
+{
+    if (system.calibration_file.isEmpty())
+        return File();
+
+    File calibrationFile (system.calibration_file);
+    if (system.calibration_mode == "capture")
+        return calibrationFile;
+
+    return calibrationFile.getSiblingFile (calibrationFile.getFileNameWithoutExtension() + "_settling"
+                                           + calibrationFile.getFileExtension());
+}
+
+/** Loads the cell table and the stored settling calibration of a system from its files */
+inline void loadSystemCalibration (NeuroLayerSystemConfig& system)
+{
+    system.calibration.clear();
+    system.settling_calibration.clear();
+
+    if (system.calibration_file.isEmpty())
+        return;
+
+    File calibrationFile (system.calibration_file);
+    if (calibrationFile.existsAsFile() || system.calibration_mode != "capture")
+        loadCalibration (calibrationFile, system.calibration);
+
+    File settlingFile = getSettlingFile (system);
+    if (settlingFile.existsAsFile())
+    {
+        std::vector<CellCalibration> cells;
+        loadCalibration (settlingFile, cells, &system.settling_calibration);
+    }
+}
+
+/** Reads one probe system: its modules, scan and channel order */
+inline void parseNeuroLayerSystem (NeuroLayerSystemConfig& system, DynamicObject* sysObj, const File& configFile)
+{
+    system = NeuroLayerSystemConfig();
+
+    if (sysObj->hasProperty("name"))
+        system.name = sysObj->getProperty("name").toString();
+
+    // Columns: [["PXI2","line0"], ...]
+    if (sysObj->hasProperty("columns"))
+    {
+        var cols = sysObj->getProperty("columns");
+        if (cols.isArray())
+        {
+            for (auto& col : *cols.getArray())
+            {
+                if (col.isArray() && col.getArray()->size() == 2)
+                {
+                    auto module = col[0].toString();
+                    auto line   = col[1].toString();
+                    system.columns[module].add (line);
+                }
+            }
+        }
+    }
+
+    // Rows: [["PXI2","Port0"], ...]
+    if (sysObj->hasProperty("rows"))
+    {
+        var rows = sysObj->getProperty("rows");
+        if (rows.isArray())
+        {
+            for (auto& row : *rows.getArray())
+            {
+                if (row.isArray() && row.getArray()->size() == 2)
+                {
+                    String module = row[0].toString();
+                    String port   = row[1].toString();
+                    system.rows[module]= port;
+                }
+            }
+        }
+    }
+    
+    if (sysObj->hasProperty("numRows"))
+    {
+        system.numRows= sysObj->getProperty("numRows");
+    }
+
+    if (sysObj->hasProperty("oversampling"))
+    {
+        system.oversampling = int(sysObj->getProperty("oversampling"));
+    }
+
+    if (sysObj->hasProperty("module_rates"))
+    {
+        system.module_rates = sysObj->getProperty("module_rates").toString();
+    }
+
+    var roiRows = sysObj->getProperty("roi_rows");
+    if (roiRows.isArray())
+    {
+        for (auto& row : *roiRows.getArray())
+            system.roi_rows.add (int(row));
+    }
+
+    // Scan sequence: [0, [5, 4], 1, [5, 4], ...], a row or [row, dwell weight] per step
+    var sequence = sysObj->getProperty("scan_sequence");
+    if (sequence.isArray())
+    {
+        for (auto& step : *sequence.getArray())
+        {
+            if (step.isArray() && step.getArray()->size() == 2)
+                system.scan_sequence.emplace_back (int(step[0]), int(step[1]));
+            else if (! step.isArray())
+                system.scan_sequence.emplace_back (int(step), 1);
+        }
+    }
+
+    // Roi sets: [[0, 1, 2], [8, 9, 10], ...]
+    var roiSets = sysObj->getProperty("roi_sets");
+    if (roiSets.isArray())
+    {
+        for (auto& set : *roiSets.getArray())
+        {
+            if (! set.isArray())
+                continue;
+
+            juce::Array<int> rows;
+            for (auto& row : *set.getArray())
+                rows.add (int(row));
+            system.roi_sets.add (rows);
+        }
+    }
+
+    if (sysObj->hasProperty("roi_event_label"))
+    {
+        system.roi_event_label = int(sysObj->getProperty("roi_event_label"));
+    }
+
+    if (sysObj->hasProperty("row_scan_memory"))
+    {
+        system.row_scan_memory = sysObj->getProperty("row_scan_memory").toString();
+    }
+
+    if (sysObj->hasProperty("stream_split"))
+    {
+        system.stream_split = sysObj->getProperty("stream_split").toString();
+    }
+
+    // Stream groups: [["PXI2Slot2", "PXI2Slot3"], ["PXI2Slot4"], ...]
+    var streamGroups = sysObj->getProperty("stream_groups");
+    if (streamGroups.isArray())
+    {
+        for (auto& group : *streamGroups.getArray())
+        {
+            if (! group.isArray())
+                continue;
+
+            juce::StringArray modules;
+            for (auto& module : *group.getArray())
+                modules.add (module.toString());
+            system.stream_groups.add (modules);
+        }
+    }
+
+    if (sysObj->hasProperty("channel_order"))
+    {
+        system.channel_order = sysObj->getProperty("channel_order").toString();
+    }
+
+    // Relative map paths are resolved against the config file
+    if (sysObj->hasProperty("probe_map_file"))
+    {
+        File mapFile = configFile.getParentDirectory().getChildFile (sysObj->getProperty("probe_map_file").toString());
+        system.probe_map_file = mapFile.getFullPathName();
+        loadProbeMap (mapFile, system.probe_map);
+    }
+
+    if (sysObj->hasProperty("calibration_mode"))
+    {
+        system.calibration_mode = sysObj->getProperty("calibration_mode").toString();
+    }
+
+    if (sysObj->hasProperty("calibration_capture_ms"))
+    {
+        system.calibration_capture_ms = int(sysObj->getProperty("calibration_capture_ms"));
+    }
+
+    if (sysObj->hasProperty("reference"))
+    {
+        system.reference = sysObj->getProperty("reference").toString();
+    }
+
+    if (sysObj->hasProperty("row_noise"))
+    {
+        system.row_noise = sysObj->getProperty("row_noise").toString();
+    }
+
+    if (sysObj->hasProperty("row_noise_stream"))
+    {
+        system.row_noise_stream = bool(sysObj->getProperty("row_noise_stream"));
+    }
+
+    if (sysObj->hasProperty("spatial_filter"))
+    {
+        system.spatial_filter = sysObj->getProperty("spatial_filter").toString();
+    }
+
+    // Laplacian weights: [center, column neighbour, row neighbour]
+    var laplacianWeights = sysObj->getProperty("laplacian_weights");
+    if (laplacianWeights.isArray() && laplacianWeights.getArray()->size() == 3)
+    {
+        system.laplacian_weights.clear();
+        for (auto& weight : *laplacianWeights.getArray())
+            system.laplacian_weights.push_back (float(weight));
+    }
+
+    // Bad cells: [[column, row], ...]
+    var badCells = sysObj->getProperty("bad_cells");
+    if (badCells.isArray())
+    {
+        for (auto& cell : *badCells.getArray())
+        {
+            if (cell.isArray() && cell.getArray()->size() == 2)
+                system.bad_cells.emplace_back (int(cell[0]), int(cell[1]));
+        }
+    }
+
+    // A capture without a file writes next to the config, one table per probe system
+    String calibrationPath = sysObj->getProperty("calibration_file").toString();
+    if (calibrationPath.isEmpty() && system.calibration_mode == "capture")
+        calibrationPath = system.name + "_calibration.csv";
+
+    if (calibrationPath.isNotEmpty())
+    {
+        File calibrationFile = configFile.getParentDirectory().getChildFile (calibrationPath);
+        system.calibration_file = calibrationFile.getFullPathName();
+        loadSystemCalibration (system);
+    }
+}
+
 inline void  parseNeuroConfig (NeuroConfig& cfg , const File& configFile)
 {
     
-    cfg.neuroLayerSystem.columns.clear();
-    cfg.neuroLayerSystem.rows.clear();
+    cfg.neuroLayerSystem = NeuroLayerSystemConfig();
+    cfg.additionalSystems.clear();
     cfg.eventInputs.clear();
+    cfg.realtime = RealtimeConfig();
+    cfg.dataBuffer = DataBufferConfig();
+    cfg.acquisition = AcquisitionConfig();
+    cfg.settling = SettlingConfig();
+    cfg.performance = PerformanceConfig();
+    cfg.chassis = ChassisConfig();
 
     if (!configFile.existsAsFile())
     {
@@ -74,48 +656,52 @@ inline void  parseNeuroConfig (NeuroConfig& cfg , const File& configFile)
         var sys = root->getProperty("neuroLayerSystem");
 
         if (auto* sysObj = sys.getDynamicObject())
+            parseNeuroLayerSystem (cfg.neuroLayerSystem, sysObj, configFile);
+    }
+
+    // ----------------------
+    // additional_systems
+    // ----------------------
+    // Each module belongs to one system: its tasks cannot be shared between two streams
+    std::set<juce::String> usedModules;
+    for (const auto& col : cfg.neuroLayerSystem.columns)
+        usedModules.insert (col.first);
+    for (const auto& row : cfg.neuroLayerSystem.rows)
+        usedModules.insert (row.first);
+
+    var systems = root->getProperty("additional_systems");
+    if (systems.isArray())
+    {
+        for (auto& sys : *systems.getArray())
         {
-            // Columns: [["PXI2","line0"], ...]
-            if (sysObj->hasProperty("columns"))
-            {
-                var cols = sysObj->getProperty("columns");
-                if (cols.isArray())
-                {
-                    for (auto& col : *cols.getArray())
-                    {
-                        if (col.isArray() && col.getArray()->size() == 2)
-                        {
-                            auto module = col[0].toString();
-                            auto line   = col[1].toString();
-                            cfg.neuroLayerSystem.columns[module].add (line);
-                        }
-                    }
-                }
-            }
+            auto* sysObj = sys.getDynamicObject();
+            if (sysObj == nullptr)
+                continue;
 
-            // Rows: [["PXI2","Port0"], ...]
-            if (sysObj->hasProperty("rows"))
-            {
-                var rows = sysObj->getProperty("rows");
-                if (rows.isArray())
-                {
-                    for (auto& row : *rows.getArray())
-                    {
-                        if (row.isArray() && row.getArray()->size() == 2)
-                        {
-                            String module = row[0].toString();
-                            String port   = row[1].toString();
-                            cfg.neuroLayerSystem.rows[module]= port;
-                        }
-                    }
-                }
-            }
-            
-            if (sysObj->hasProperty("numRows"))
+            NeuroLayerSystemConfig system;
+            parseNeuroLayerSystem (system, sysObj, configFile);
+
+            if (! sysObj->hasProperty("name"))
+                system.name = "NeuroLayer " + juce::String (cfg.additionalSystems.size() + 2);
+
+            std::set<juce::String> modules;
+            for (const auto& col : system.columns)
+                modules.insert (col.first);
+            for (const auto& row : system.rows)
+                modules.insert (row.first);
+
+            bool shared = false;
+            for (const auto& module : modules)
+                shared |= usedModules.count (module) > 0;
+
+            if (shared || system.columns.empty())
             {
-                cfg.neuroLayerSystem.numRows= sysObj->getProperty("numRows");
+                LOGE("Probe system " + system.name + " ignored: no AI module, or a module already used by another system");
+                continue;
             }
 
+            usedModules.insert (modules.begin(), modules.end());
+            cfg.additionalSystems.add (system);
         }
     }
 
@@ -132,6 +718,8 @@ inline void  parseNeuroConfig (NeuroConfig& cfg , const File& configFile)
             cfg.startEventOutput.pulse_duration= float(startObj->getProperty("pulse_duration"));
             cfg.startEventOutput.name   = startObj->getProperty("module_name").toString();
             cfg.startEventOutput.digital_line  = startObj->getProperty("digital_line").toString();
+            cfg.startEventOutput.counter       = startObj->getProperty("counter").toString();
+            cfg.startEventOutput.pulse_terminal= startObj->getProperty("pulse_terminal").toString();
         }
     }
 
@@ -157,5 +745,121 @@ inline void  parseNeuroConfig (NeuroConfig& cfg , const File& configFile)
             }
         }
     }
-   
-}
\ No newline at end of file
+
+    // ----------------------
+    // realtime
+    // ----------------------
+    if (root->hasProperty("realtime"))
+    {
+        var rt = root->getProperty("realtime");
+        if (auto* rtObj = rt.getDynamicObject())
+        {
+            if (rtObj->hasProperty("thread_priority"))
+                cfg.realtime.thread_priority = rtObj->getProperty("thread_priority").toString();
+            if (rtObj->hasProperty("rt_priority"))
+                cfg.realtime.rt_priority = int(rtObj->getProperty("rt_priority"));
+            if (rtObj->hasProperty("lock_memory"))
+                cfg.realtime.lock_memory = bool(rtObj->getProperty("lock_memory"));
+            if (rtObj->hasProperty("huge_pages"))
+                cfg.realtime.huge_pages = bool(rtObj->getProperty("huge_pages"));
+
+            var cpus = rtObj->getProperty("cpu_affinity");
+            if (cpus.isArray())
+            {
+                for (auto& cpu : *cpus.getArray())
+                    cfg.realtime.cpu_affinity.add (int(cpu));
+            }
+        }
+    }
+
+    // ----------------------
+    // data_buffer
+    // ----------------------
+    if (root->hasProperty("data_buffer"))
+    {
+        var buffer = root->getProperty("data_buffer");
+        if (auto* bufferObj = buffer.getDynamicObject())
+        {
+            if (bufferObj->hasProperty("headroom_ms"))
+                cfg.dataBuffer.headroom_ms = float(bufferObj->getProperty("headroom_ms"));
+            if (bufferObj->hasProperty("overrun_policy"))
+                cfg.dataBuffer.overrun_policy = bufferObj->getProperty("overrun_policy").toString();
+            if (bufferObj->hasProperty("overrun_event_label"))
+                cfg.dataBuffer.overrun_event_label = int(bufferObj->getProperty("overrun_event_label"));
+        }
+    }
+
+    // ----------------------
+    // acquisition
+    // ----------------------
+    if (root->hasProperty("acquisition"))
+    {
+        var acquisition = root->getProperty("acquisition");
+        if (auto* acqObj = acquisition.getDynamicObject())
+        {
+            if (acqObj->hasProperty("mode"))
+                cfg.acquisition.mode = acqObj->getProperty("mode").toString();
+        }
+    }
+
+    // ----------------------
+    // settling
+    // ----------------------
+    if (root->hasProperty("settling"))
+    {
+        var settling = root->getProperty("settling");
+        if (auto* settlingObj = settling.getDynamicObject())
+        {
+            if (settlingObj->hasProperty("mode"))
+                cfg.settling.mode = settlingObj->getProperty("mode").toString();
+            if (settlingObj->hasProperty("discard_samples"))
+                cfg.settling.discard_samples = int(settlingObj->getProperty("discard_samples"));
+            if (settlingObj->hasProperty("tolerance_mv"))
+                cfg.settling.tolerance_mv = float(settlingObj->getProperty("tolerance_mv"));
+            if (settlingObj->hasProperty("recalibrate"))
+                cfg.settling.recalibrate = bool(settlingObj->getProperty("recalibrate"));
+        }
+    }
+
+    // ----------------------
+    // performance
+    // ----------------------
+    if (root->hasProperty("performance"))
+    {
+        var performance = root->getProperty("performance");
+        if (auto* perfObj = performance.getDynamicObject())
+        {
+            if (perfObj->hasProperty("input_buffer_ms"))
+                cfg.performance.input_buffer_ms = float(perfObj->getProperty("input_buffer_ms"));
+            if (perfObj->hasProperty("transfer_mechanism"))
+                cfg.performance.transfer_mechanism = perfObj->getProperty("transfer_mechanism").toString();
+            if (perfObj->hasProperty("request_condition"))
+                cfg.performance.request_condition = perfObj->getProperty("request_condition").toString();
+            if (perfObj->hasProperty("read_wait_mode"))
+                cfg.performance.read_wait_mode = perfObj->getProperty("read_wait_mode").toString();
+        }
+    }
+
+    // ----------------------
+    // chassis
+    // ----------------------
+    if (root->hasProperty("chassis"))
+    {
+        var chassis = root->getProperty("chassis");
+        if (auto* chassisObj = chassis.getDynamicObject())
+        {
+            if (chassisObj->hasProperty("mode"))
+                cfg.chassis.mode = chassisObj->getProperty("mode").toString();
+            if (chassisObj->hasProperty("ref_clock_terminal"))
+                cfg.chassis.ref_clock_terminal = chassisObj->getProperty("ref_clock_terminal").toString();
+            if (chassisObj->hasProperty("start_terminal"))
+                cfg.chassis.start_terminal = chassisObj->getProperty("start_terminal").toString();
+            if (chassisObj->hasProperty("sync_event_label"))
+                cfg.chassis.sync_event_label = int(chassisObj->getProperty("sync_event_label"));
+            if (chassisObj->hasProperty("sync_period_s"))
+                cfg.chassis.sync_period_s = float(chassisObj->getProperty("sync_period_s"));
+            if (chassisObj->hasProperty("sync_tolerance_frames"))
+                cfg.chassis.sync_tolerance_frames = int(chassisObj->getProperty("sync_tolerance_frames"));
+        }
+    }
+}
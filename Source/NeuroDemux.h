@@ -0,0 +1,707 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2025 VIB Haesler lab
+ Developed by Marine Guyot - CodingResearcher
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef NEURODEMUX_H_DEFINED
+#define NEURODEMUX_H_DEFINED
+
+#include <DataThreadHeaders.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "nidaq-api/NIDAQmx.h"
+
+/* ================================================================
+   Demux plan
+   ================================================================ */
+
+/** Order of the cells within an output frame */
+enum class ChannelOrder
+{
+    ColumnMajor, // all rows of column 0, then column 1, ...
+    RowMajor, // all columns of row 0, then row 1, ...
+    Mapped // explicit probe map
+};
+
+/** One step of the row scan: a probe row held for dwell samples of the frame clock */
+struct ScanStep
+{
+    int row = 0;
+    int dwell = 1;
+
+    bool operator== (const ScanStep& other) const { return row == other.row && dwell == other.dwell; }
+};
+
+/** Row scan of one frame, in order. Rows may repeat and dwell may differ between steps. */
+typedef std::vector<ScanStep> ScanSequence;
+
+/** The plain scan: each row once, in order, for dwellSamples samples */
+inline ScanSequence makeScanSequence (const std::vector<int>& rows, int dwellSamples)
+{
+    ScanSequence sequence;
+    for (int row : rows)
+        sequence.push_back ({ row, jmax (1, dwellSamples) });
+    return sequence;
+}
+
+/** Distinct rows of the sequence, ascending: the cell rows of its frames */
+inline std::vector<int> getSequenceRows (const ScanSequence& sequence)
+{
+    std::vector<int> rows;
+    for (const auto& step : sequence)
+        rows.push_back (step.row);
+
+    std::sort (rows.begin(), rows.end());
+    rows.erase (std::unique (rows.begin(), rows.end()), rows.end());
+    return rows;
+}
+
+/** Samples of the frame clock in one frame of the sequence */
+inline int getSequenceLength (const ScanSequence& sequence)
+{
+    int length = 0;
+    for (const auto& step : sequence)
+        length += step.dwell;
+    return length;
+}
+
+/**
+    Describes how one block of raw AI samples maps to frame-major cells.
+
+    Each AI line sees the probe rows in the order of the scan sequence; a
+    frame is samplesPerFrame samples per line, the sum of the step dwells.
+    The first settleSamples of each dwell carry the multiplexer settling
+    transient and are skipped, the others are averaged into a single cell
+    value, over all the steps of a row when it is scanned several times.
+    A module clocked rateFactor times faster than the frame clock dwells
+    rateFactor times longer on each row, so its frames stay aligned with
+    the others and the extra samples are averaged too.
+    The AI buffers are grouped by channel: line l of module m holds
+    getSamplesPerFrame (m) * blockFrames samples.
+    Each cell value is then corrected as (mean - cellOffset) * cellGain, in
+    the same pass (offset 0 and gain 1 when there is no calibration).
+*/
+struct DemuxPlan
+{
+    /** A scan step in plan terms: cell row, start and length in samples of the frame clock */
+    struct Slot
+    {
+        int row;
+        int offset;
+        int dwell;
+    };
+
+    int numModules = 0;
+    int numColumns = 0; // total AI lines
+    int numRows = 0; // distinct scanned rows per column
+    int numCells = 0;
+    int dwellSamples = 1; // ADC samples per row at the frame clock rate, when uniform
+    int minDwell = 1; // shortest step of the sequence
+    int samplesPerFrame = 0; // samples per frame at the frame clock rate (event lines)
+    int blockFrames = 0;
+
+    /** True when each row is scanned once, in order, with the same dwell: the specialised kernels apply */
+    bool uniform = true;
+
+    std::vector<int> scannedRows; // probe row of each cell row, ascending
+    std::vector<Slot> slots; // scan steps, in order
+    std::vector<int> linesPerModule;
+    std::vector<int> firstColumn; // first probe column of each module
+    std::vector<int> settleSamples; // samples discarded at the start of each dwell, per module
+    std::vector<int> rateFactor; // sample clock of each module, as a multiple of the frame clock rate
+    std::vector<float> rowWeight; // 1 / samples kept per row, indexed module * numRows + row
+    std::vector<float> cellOffset; // subtracted from each cell, indexed column * numRows + cell row
+    std::vector<float> cellGain; // applied after the offset, indexed like cellOffset
+
+    ChannelOrder order = ChannelOrder::ColumnMajor;
+    std::vector<int> outputIndex; // output channel of each cell, indexed by column * numRows + cell row
+    std::vector<int> outputColumn; // probe column of each output channel
+    std::vector<int> outputRow; // probe row of each output channel
+
+    int getDwell (int module) const { return dwellSamples * rateFactor[module]; }
+    int getMinDwell (int module) const { return minDwell * rateFactor[module]; }
+    int getSamplesPerFrame (int module) const { return samplesPerFrame * rateFactor[module]; }
+    size_t getLineStride (int module) const { return size_t (getSamplesPerFrame (module)) * blockFrames; }
+
+    /** Module sampling a probe column */
+    int getModule (int column) const
+    {
+        int module = 0;
+        while (module + 1 < numModules && firstColumn[module + 1] <= column)
+            module++;
+        return module;
+    }
+
+    /** Sets the discard of a module, keeping at least one sample of its shortest step */
+    void setSettle (int module, int samples)
+    {
+        settleSamples[module] = jlimit (0, getMinDwell (module) - 1, samples);
+
+        float* weight = rowWeight.data() + module * numRows;
+        std::fill (weight, weight + numRows, 0.0f);
+
+        for (const auto& slot : slots)
+            weight[slot.row] += float (slot.dwell * rateFactor[module] - settleSamples[module]);
+
+        for (int row = 0; row < numRows; ++row)
+            weight[row] = weight[row] > 0 ? 1.0f / weight[row] : 0.0f;
+    }
+};
+
+/** Builds the plan for the given modules and scan sequence (probe rows, in scan order). probeMap lists the
+    (column, probe row) of each output channel and is only used with ChannelOrder::Mapped; entries for rows
+    that are not scanned are skipped, and an invalid map falls back to column-major.
+    rateFactors gives the clock multiple of each module (all 1 if empty). */
+inline DemuxPlan makeDemuxPlan (const std::vector<int>& linesPerModule,
+                                const ScanSequence& sequence,
+                                int blockFrames,
+                                ChannelOrder order = ChannelOrder::ColumnMajor,
+                                const std::vector<std::pair<int, int>>& probeMap = {},
+                                const std::vector<int>& rateFactors = {})
+{
+    DemuxPlan plan;
+    plan.numModules = int (linesPerModule.size());
+    plan.blockFrames = blockFrames;
+    plan.linesPerModule = linesPerModule;
+    plan.settleSamples.assign (linesPerModule.size(), 0);
+    plan.rateFactor.assign (linesPerModule.size(), 1);
+
+    if (rateFactors.size() == linesPerModule.size())
+    {
+        for (size_t module = 0; module < rateFactors.size(); ++module)
+            plan.rateFactor[module] = jmax (1, rateFactors[module]);
+    }
+
+    // Cells are the distinct rows of the sequence
+    plan.scannedRows = getSequenceRows (sequence);
+    plan.numRows = int (plan.scannedRows.size());
+
+    plan.dwellSamples = sequence.empty() ? 1 : jmax (1, sequence.front().dwell);
+    plan.minDwell = plan.dwellSamples;
+    plan.uniform = int (sequence.size()) == plan.numRows;
+
+    for (size_t step = 0; step < sequence.size(); ++step)
+    {
+        const int dwell = jmax (1, sequence[step].dwell);
+        const int row = int (std::lower_bound (plan.scannedRows.begin(), plan.scannedRows.end(), sequence[step].row)
+                             - plan.scannedRows.begin());
+
+        plan.slots.push_back ({ row, plan.samplesPerFrame, dwell });
+        plan.samplesPerFrame += dwell;
+        plan.minDwell = jmin (plan.minDwell, dwell);
+        plan.uniform = plan.uniform && row == int (step) && dwell == plan.dwellSamples;
+    }
+
+    for (int lines : linesPerModule)
+    {
+        plan.firstColumn.push_back (plan.numColumns);
+        plan.numColumns += lines;
+    }
+
+    plan.rowWeight.assign (size_t (plan.numModules) * plan.numRows, 0.0f);
+    for (int module = 0; module < plan.numModules; ++module)
+        plan.setSettle (module, 0);
+
+    plan.numCells = plan.numColumns * plan.numRows;
+    plan.cellOffset.assign (plan.numCells, 0.0f);
+    plan.cellGain.assign (plan.numCells, 1.0f);
+
+    if (order == ChannelOrder::Mapped)
+    {
+        std::map<int, int> scanIndex; // probe row -> scanned row
+        for (int row = 0; row < plan.numRows; ++row)
+            scanIndex[plan.scannedRows[row]] = row;
+
+        std::vector<int> outputIndex (plan.numCells, -1);
+        bool valid = true;
+        int ch = 0;
+
+        for (const auto& cell : probeMap)
+        {
+            auto scanned = scanIndex.find (cell.second);
+            if (scanned == scanIndex.end())
+                continue;
+
+            const int column = cell.first;
+            const int row = scanned->second;
+
+            if (! isPositiveAndBelow (column, plan.numColumns) || ch >= plan.numCells
+                || outputIndex[column * plan.numRows + row] != -1)
+            {
+                valid = false;
+                break;
+            }
+
+            outputIndex[column * plan.numRows + row] = ch++;
+        }
+
+        valid = valid && ch == plan.numCells;
+
+        if (valid)
+        {
+            plan.outputIndex = outputIndex;
+        }
+        else
+        {
+            LOGE ("Probe map does not list each of the ", plan.numCells, " scanned cells exactly once, using column-major order");
+            order = ChannelOrder::ColumnMajor;
+        }
+    }
+
+    plan.order = order;
+
+    if (order != ChannelOrder::Mapped)
+    {
+        plan.outputIndex.resize (plan.numCells);
+        for (int column = 0; column < plan.numColumns; ++column)
+        {
+            for (int row = 0; row < plan.numRows; ++row)
+            {
+                plan.outputIndex[column * plan.numRows + row] = order == ChannelOrder::RowMajor
+                                                                    ? row * plan.numColumns + column
+                                                                    : column * plan.numRows + row;
+            }
+        }
+    }
+
+    plan.outputColumn.resize (plan.numCells);
+    plan.outputRow.resize (plan.numCells);
+    for (int column = 0; column < plan.numColumns; ++column)
+    {
+        for (int row = 0; row < plan.numRows; ++row)
+        {
+            plan.outputColumn[plan.outputIndex[column * plan.numRows + row]] = column;
+            plan.outputRow[plan.outputIndex[column * plan.numRows + row]] = plan.scannedRows[row];
+        }
+    }
+
+    return plan;
+}
+
+/** Loads the calibration of the plan's cells from a probe-wide table, indexed column * probeRows + probe row.
+    Does not allocate, so it can run between blocks. */
+inline void setCellCalibration (DemuxPlan& plan, const std::vector<float>& offset, const std::vector<float>& gain, int probeRows)
+{
+    for (int column = 0; column < plan.numColumns; ++column)
+    {
+        for (int row = 0; row < plan.numRows; ++row)
+        {
+            const size_t probeCell = size_t (column) * probeRows + plan.scannedRows[row];
+            const bool known = probeCell < offset.size() && probeCell < gain.size();
+
+            plan.cellOffset[column * plan.numRows + row] = known ? offset[probeCell] : 0.0f;
+            plan.cellGain[column * plan.numRows + row] = known ? gain[probeCell] : 1.0f;
+        }
+    }
+}
+
+/* ================================================================
+   Generic kernels
+   ================================================================ */
+
+/** Mean of the dwellSamples samples of one row */
+inline float dwellMean (const NIDAQ::float64* src, int dwellSamples)
+{
+    if (dwellSamples == 1)
+        return float (src[0]);
+
+    NIDAQ::float64 sum = 0;
+    for (int s = 0; s < dwellSamples; ++s)
+        sum += src[s];
+
+    return float (sum / dwellSamples);
+}
+
+/** Runtime-sized demux, used for any geometry without a specialised kernel.
+    Like all the demux kernels, it fills frames [firstFrame, firstFrame + numFrames) of the output block. */
+inline void demuxGeneric (const DemuxPlan& plan, const NIDAQ::float64* const* aiData, float* output, int firstFrame, int numFrames)
+{
+    for (int frame = firstFrame; frame < firstFrame + numFrames; ++frame)
+    {
+        float* dst = output + size_t (frame) * plan.numCells;
+
+        for (int module = 0; module < plan.numModules; ++module)
+        {
+            const int dwell = plan.getDwell (module);
+            const int settle = plan.settleSamples[module];
+            const int kept = dwell - settle;
+            const size_t lineStride = plan.getLineStride (module);
+            const size_t frameOffset = size_t (frame) * plan.getSamplesPerFrame (module);
+
+            for (int line = 0; line < plan.linesPerModule[module]; ++line)
+            {
+                const NIDAQ::float64* src = aiData[module] + line * lineStride + frameOffset + settle;
+                const int column = plan.firstColumn[module] + line;
+                const float* offset = plan.cellOffset.data() + column * plan.numRows;
+                const float* gain = plan.cellGain.data() + column * plan.numRows;
+
+                if (plan.order == ChannelOrder::ColumnMajor)
+                {
+                    float* cells = dst + column * plan.numRows;
+                    for (int row = 0; row < plan.numRows; ++row)
+                        cells[row] = (dwellMean (src + row * dwell, kept) - offset[row]) * gain[row];
+                }
+                else if (plan.order == ChannelOrder::RowMajor)
+                {
+                    float* cells = dst + column;
+                    for (int row = 0; row < plan.numRows; ++row)
+                        cells[row * plan.numColumns] = (dwellMean (src + row * dwell, kept) - offset[row]) * gain[row];
+                }
+                else
+                {
+                    const int* index = plan.outputIndex.data() + column * plan.numRows;
+                    for (int row = 0; row < plan.numRows; ++row)
+                        dst[index[row]] = (dwellMean (src + row * dwell, kept) - offset[row]) * gain[row];
+                }
+            }
+        }
+    }
+}
+
+/** Demux of an arbitrary scan sequence: each cell averages the kept samples of all the steps of its row */
+inline void demuxSequence (const DemuxPlan& plan, const NIDAQ::float64* const* aiData, float* output, int firstFrame, int numFrames)
+{
+    for (int frame = firstFrame; frame < firstFrame + numFrames; ++frame)
+    {
+        float* dst = output + size_t (frame) * plan.numCells;
+
+        for (int module = 0; module < plan.numModules; ++module)
+        {
+            const int factor = plan.rateFactor[module];
+            const int settle = plan.settleSamples[module];
+            const float* weight = plan.rowWeight.data() + module * plan.numRows;
+            const size_t lineStride = plan.getLineStride (module);
+            const size_t frameOffset = size_t (frame) * plan.getSamplesPerFrame (module);
+
+            for (int line = 0; line < plan.linesPerModule[module]; ++line)
+            {
+                const NIDAQ::float64* src = aiData[module] + line * lineStride + frameOffset;
+                const int column = plan.firstColumn[module] + line;
+                const int* index = plan.outputIndex.data() + column * plan.numRows;
+                const float* offset = plan.cellOffset.data() + column * plan.numRows;
+                const float* gain = plan.cellGain.data() + column * plan.numRows;
+
+                for (int row = 0; row < plan.numRows; ++row)
+                    dst[index[row]] = 0.0f;
+
+                for (const auto& slot : plan.slots)
+                {
+                    const NIDAQ::float64* samples = src + slot.offset * factor;
+                    NIDAQ::float64 sum = 0;
+
+                    for (int s = settle; s < slot.dwell * factor; ++s)
+                        sum += samples[s];
+
+                    dst[index[slot.row]] += float (sum) * weight[slot.row];
+                }
+
+                for (int row = 0; row < plan.numRows; ++row)
+                    dst[index[row]] = (dst[index[row]] - offset[row]) * gain[row];
+            }
+        }
+    }
+}
+
+/** Sets mask on every frame where the event line was high at least once */
+inline void eventsGeneric (const NIDAQ::uInt32* data, int samplesPerFrame, int blockFrames, uint64 mask, uint64* eventCodes)
+{
+    for (int frame = 0; frame < blockFrames; ++frame)
+    {
+        const NIDAQ::uInt32* src = data + size_t (frame) * samplesPerFrame;
+        NIDAQ::uInt32 active = 0;
+
+        for (int s = 0; s < samplesPerFrame; ++s)
+            active |= src[s];
+
+        if (active != 0)
+            eventCodes[frame] |= mask;
+    }
+}
+
+/* ================================================================
+   Specialised kernels
+   ================================================================ */
+
+template <int Dwell>
+inline float dwellMeanFixed (const NIDAQ::float64* src, int settle)
+{
+    if constexpr (Dwell == 1)
+    {
+        return float (src[0]);
+    }
+    else
+    {
+        NIDAQ::float64 sum = 0;
+        for (int s = settle; s < Dwell; ++s)
+            sum += src[s];
+
+        return float (sum / (Dwell - settle));
+    }
+}
+
+/** Demux with the geometry, dwell and order known at compile time, so the inner loops unroll and vectorise */
+template <int Lines, int Modules, int Rows, int Dwell, ChannelOrder Order>
+void demuxFixed (const DemuxPlan& plan, const NIDAQ::float64* const* aiData, float* output, int firstFrame, int numFrames)
+{
+    constexpr int numColumns = Lines * Modules;
+    constexpr int numCells = numColumns * Rows;
+    constexpr int samplesPerFrame = Rows * Dwell;
+    const size_t lineStride = size_t (samplesPerFrame) * plan.blockFrames;
+
+    for (int frame = firstFrame; frame < firstFrame + numFrames; ++frame)
+    {
+        float* dst = output + size_t (frame) * numCells;
+        const size_t frameOffset = size_t (frame) * samplesPerFrame;
+
+        for (int module = 0; module < Modules; ++module)
+        {
+            const NIDAQ::float64* moduleData = aiData[module] + frameOffset;
+            const int settle = plan.settleSamples[module];
+
+            for (int line = 0; line < Lines; ++line)
+            {
+                const NIDAQ::float64* src = moduleData + line * lineStride;
+                const int column = module * Lines + line;
+                const float* offset = plan.cellOffset.data() + column * Rows;
+                const float* gain = plan.cellGain.data() + column * Rows;
+
+                if constexpr (Order == ChannelOrder::ColumnMajor)
+                {
+                    float* cells = dst + column * Rows;
+                    for (int row = 0; row < Rows; ++row)
+                        cells[row] = (dwellMeanFixed<Dwell> (src + row * Dwell, settle) - offset[row]) * gain[row];
+                }
+                else if constexpr (Order == ChannelOrder::RowMajor)
+                {
+                    float* cells = dst + column;
+                    for (int row = 0; row < Rows; ++row)
+                        cells[row * numColumns] = (dwellMeanFixed<Dwell> (src + row * Dwell, settle) - offset[row]) * gain[row];
+                }
+                else
+                {
+                    const int* index = plan.outputIndex.data() + column * Rows;
+                    for (int row = 0; row < Rows; ++row)
+                        dst[index[row]] = (dwellMeanFixed<Dwell> (src + row * Dwell, settle) - offset[row]) * gain[row];
+                }
+            }
+        }
+    }
+}
+
+/** samplesPerFrame only keeps the EventKernel signature, the compiled SamplesPerFrame is used */
+template <int SamplesPerFrame>
+void eventsFixed (const NIDAQ::uInt32* data, int samplesPerFrame, int blockFrames, uint64 mask, uint64* eventCodes)
+{
+    jassert (samplesPerFrame == SamplesPerFrame);
+    ignoreUnused (samplesPerFrame);
+
+    for (int frame = 0; frame < blockFrames; ++frame)
+    {
+        const NIDAQ::uInt32* src = data + size_t (frame) * SamplesPerFrame;
+        NIDAQ::uInt32 active = 0;
+
+        for (int s = 0; s < SamplesPerFrame; ++s)
+            active |= src[s];
+
+        if (active != 0)
+            eventCodes[frame] |= mask;
+    }
+}
+
+/* ================================================================
+   Settling calibration
+   ================================================================ */
+
+/** Settling measured on one module */
+struct SettlingCalibration
+{
+    int discardSamples = 0; // samples dropped at the start of each dwell
+    double residualEnergy = 0; // mean squared deviation (V^2) of the kept samples from the settled value
+};
+
+/**
+    Measures the row-switch transient of each module on one raw block.
+
+    The last sample of each step is taken as the settled value. For every position
+    within a step the RMS deviation from it is averaged over all lines, steps and
+    frames of the module; the discard is the first position after which it stays
+    within toleranceVolts. A fixedDiscard >= 0 skips the search and only measures
+    the residual. Discards count samples of the module's own clock, and at least
+    one sample of the shortest step is always kept.
+*/
+inline std::vector<SettlingCalibration> calibrateSettling (const DemuxPlan& plan,
+                                                           const NIDAQ::float64* const* aiData,
+                                                           double toleranceVolts,
+                                                           int fixedDiscard = -1)
+{
+    std::vector<SettlingCalibration> result (plan.numModules);
+
+    for (int module = 0; module < plan.numModules; ++module)
+    {
+        const int factor = plan.rateFactor[module];
+        const int minDwell = plan.getMinDwell (module);
+        const size_t lineStride = plan.getLineStride (module);
+        const size_t samplesPerFrame = plan.getSamplesPerFrame (module);
+
+        // Positions beyond the shortest step cannot be discarded, so only those are measured
+        std::vector<double> energy (minDwell, 0.0);
+        double count = 0;
+
+        for (int line = 0; line < plan.linesPerModule[module]; ++line)
+        {
+            for (int frame = 0; frame < plan.blockFrames; ++frame)
+            {
+                const NIDAQ::float64* src = aiData[module] + line * lineStride + frame * samplesPerFrame;
+
+                for (const auto& slot : plan.slots)
+                {
+                    const NIDAQ::float64* samples = src + slot.offset * factor;
+                    const NIDAQ::float64 settled = samples[slot.dwell * factor - 1];
+
+                    for (int s = 0; s < minDwell; ++s)
+                    {
+                        const double deviation = samples[s] - settled;
+                        energy[s] += deviation * deviation;
+                    }
+
+                    count += 1;
+                }
+            }
+        }
+
+        for (auto& e : energy)
+            e /= jmax (1.0, count);
+
+        int discard = fixedDiscard >= 0 ? jmin (fixedDiscard, minDwell - 1) : minDwell - 1;
+
+        if (fixedDiscard < 0)
+        {
+            const double toleranceEnergy = toleranceVolts * toleranceVolts;
+            while (discard > 0 && energy[discard - 1] <= toleranceEnergy)
+                --discard;
+        }
+
+        double residual = 0;
+        for (int s = discard; s < minDwell; ++s)
+            residual += energy[s];
+
+        result[module].discardSamples = discard;
+        result[module].residualEnergy = residual / (minDwell - discard);
+    }
+
+    return result;
+}
+
+/* ================================================================
+   Kernel selection
+   ================================================================ */
+
+typedef void (*DemuxKernel) (const DemuxPlan&, const NIDAQ::float64* const*, float*, int, int);
+typedef void (*EventKernel) (const NIDAQ::uInt32*, int, int, uint64, uint64*);
+
+struct DemuxKernels
+{
+    DemuxKernel demux = &demuxGeneric;
+    EventKernel events = &eventsGeneric;
+    String name = "generic";
+};
+
+/** A probe geometry with compiled kernels: lines per module x modules x rows per frame x samples per row,
+    with one demux kernel per ChannelOrder */
+struct DemuxGeometry
+{
+    int lines;
+    int modules;
+    int rows;
+    int dwell;
+    DemuxKernel demux[3];
+    EventKernel events;
+};
+
+#define NEURO_DEMUX_GEOMETRY(lines, modules, rows, dwell)                       \
+    {                                                                           \
+        lines, modules, rows, dwell,                                            \
+            { &demuxFixed<lines, modules, rows, dwell, ChannelOrder::ColumnMajor>, \
+              &demuxFixed<lines, modules, rows, dwell, ChannelOrder::RowMajor>,    \
+              &demuxFixed<lines, modules, rows, dwell, ChannelOrder::Mapped> },    \
+            &eventsFixed<rows * dwell>                                          \
+    }
+
+/** Registered geometries. 8 x 4 x 32 is the shipped config.json (8 rows on each of the 4 row modules),
+    also compiled for 2x and 4x oversampling. */
+static const DemuxGeometry registeredGeometries[] = {
+    NEURO_DEMUX_GEOMETRY (8, 4, 32, 1),
+    NEURO_DEMUX_GEOMETRY (8, 4, 32, 2),
+    NEURO_DEMUX_GEOMETRY (8, 4, 32, 4),
+    NEURO_DEMUX_GEOMETRY (8, 2, 16, 1),
+    NEURO_DEMUX_GEOMETRY (8, 1, 8, 1),
+    NEURO_DEMUX_GEOMETRY (8, 8, 64, 1),
+};
+
+#undef NEURO_DEMUX_GEOMETRY
+
+/** Picks the specialised kernels matching the plan, or the generic ones */
+inline DemuxKernels selectDemuxKernels (const DemuxPlan& plan)
+{
+    DemuxKernels kernels;
+
+    if (! plan.uniform)
+    {
+        kernels.demux = &demuxSequence;
+        kernels.name = "sequence";
+        return kernels;
+    }
+
+    if (plan.linesPerModule.empty())
+        return kernels;
+
+    for (int factor : plan.rateFactor)
+    {
+        if (factor != 1)
+            return kernels;
+    }
+
+    const int lines = plan.linesPerModule.front();
+    for (int moduleLines : plan.linesPerModule)
+    {
+        if (moduleLines != lines)
+            return kernels;
+    }
+
+    for (const auto& geometry : registeredGeometries)
+    {
+        if (geometry.lines == lines && geometry.modules == plan.numModules && geometry.rows == plan.numRows
+            && geometry.dwell == plan.dwellSamples)
+        {
+            kernels.demux = geometry.demux[int (plan.order)];
+            kernels.events = geometry.events;
+            kernels.name = String (lines) + "x" + String (plan.numModules) + "x" + String (plan.numRows)
+                           + "x" + String (plan.dwellSamples);
+            break;
+        }
+    }
+
+    return kernels;
+}
+
+#endif
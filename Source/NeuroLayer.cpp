@@ -26,92 +26,756 @@
 #include <chrono>
 #include <math.h>
 
-NeuroProcessor::NeuroProcessor(NeuroConfig& cfg)
-    : Thread("HaeslerProbe")
+NeuroProcessor::NeuroProcessor (const NeuroConfig& cfg, int systemIndex, NIDAQ::float64 chassisRate)
+    : Thread ("HaeslerProbe" + (systemIndex > 0 ? String (systemIndex + 1) : String())),
+      systemIndex (systemIndex)
 {
-    closeTask();
-    // Clear existing devices
-    AIdevices.clear();
-    DIdevices.clear();
-    eventDevices.clear();
-    startDevice = nullptr;
+    updateConfig (cfg, chassisRate);
+}
+
+void NeuroProcessor::updateConfig (const NeuroConfig& cfg, NIDAQ::float64 chassisRate)
+{
+    const NeuroLayerSystemConfig& system = isFollower() ? cfg.additionalSystems.getReference (systemIndex - 1)
+                                                        : cfg.neuroLayerSystem;
+    const int previousCellNumber = getCellNumber();
+    int reused = 0;
+    int rebuilt = 0;
+
+    closeTask (true);
+    realtimeConfig = cfg.realtime;
+    bufferConfig = cfg.dataBuffer;
+    settlingConfig = cfg.settling;
+    performanceConfig = cfg.performance;
+    chassisConfig = cfg.chassis;
+
+    if (chassisConfig.mode != "standalone"
+        && (chassisConfig.ref_clock_terminal.isEmpty() || chassisConfig.start_terminal.isEmpty()))
+    {
+        LOGE ("Chassis mode ", chassisConfig.mode, " needs ref_clock_terminal and start_terminal, running standalone");
+        chassisConfig.mode = "standalone";
+    }
+
+    if (bufferConfig.overrun_policy == "drop_oldest")
+        overrunPolicy = OverrunPolicy::DropOldest;
+    else if (bufferConfig.overrun_policy == "drop_newest")
+        overrunPolicy = OverrunPolicy::DropNewest;
+    else
+        overrunPolicy = OverrunPolicy::Block;
     numProbeColumn = 0;
     numProbeRow = 0;
+    systemName = system.name;
+    oversampling = jmax (1, system.oversampling);
+    rowScanOnboard = system.row_scan_memory == "onboard";
 
     // --- Setup AI Devices (columns) ---
-    // Each column corresponds to one PXI module with all its lines
-    int maxColumnsPerStation = 0;
+    // Each column corresponds to one PXI module with all its lines.
+    // Modules whose lines did not change keep their channel object.
     int dev_index = 0;
 
-    for (const auto& col : cfg.neuroLayerSystem.columns)
+    OwnedArray<InputAIChannel> previousAI;
+    previousAI.swapWith (AIdevices);
+
+    for (const auto& col : system.columns)
     {
-        
-        const String moduleName = std::get<0>(col); // PXI module name
-        juce::StringArray analogLines;
+        const String moduleName = std::get<0> (col); // PXI module name
+        const juce::StringArray& analogLines = std::get<1> (col);
 
-        analogLines =  std::get<1>(col);
+        InputAIChannel* aiDevice = nullptr;
+        for (int i = 0; i < previousAI.size(); i++)
+        {
+            if (previousAI[i]->getName() == moduleName && previousAI[i]->analogLines_ == analogLines
+                && previousAI[i]->getDeviceIndex() == dev_index)
+            {
+                aiDevice = previousAI.removeAndReturn (i);
+                break;
+            }
+        }
 
-        maxColumnsPerStation = std::max(maxColumnsPerStation, int(analogLines.size()));
-        std::cout << moduleName << ": " << dev_index << std::endl; 
+        if (aiDevice != nullptr)
+        {
+            reused++;
+        }
+        else
+        {
+            std::cout << moduleName << ": " << dev_index << std::endl;
+            aiDevice = new InputAIChannel (moduleName, analogLines, dev_index);
+            configureDevice (aiDevice);
+            rebuilt++;
+        }
 
-        auto* aiDevice = new InputAIChannel (moduleName, analogLines, dev_index);
-        aiDevice->configure();
-        AIdevices.add(aiDevice);
+        AIdevices.add (aiDevice);
         numProbeColumn += int (analogLines.size());
 
-        dev_index+=1;
+        dev_index += 1;
     }
 
-     // --- Compute Sample Rate ---
-    // Take the minimum sample rate among columns if columns have different numbers of lines
-    sampleRate = 500000.0 / maxColumnsPerStation;
+    // --- Compute Sample Rate ---
+    // The frame clock runs at the rate of the slowest module, as reported by the driver,
+    // and is read back from the master since the driver may coerce it
+    sampleRate = 0;
+    for (auto* dev : AIdevices)
+        sampleRate = sampleRate > 0 ? jmin (sampleRate, dev->getMaxLineRate()) : dev->getMaxLineRate();
+
+    // An additional system samples on the frame clock of system 0
+    if (isFollower())
+    {
+        if (chassisRate > sampleRate)
+            LOGE (systemName, ": modules slower than the chassis clock (", sampleRate, " < ", chassisRate, " S/s)");
 
-    for (const auto& dev : AIdevices)
+        sampleRate = chassisRate;
+        LOGC (systemName, " sample rate: ", sampleRate, " S/s from the chassis clock");
+    }
+    else if (! AIdevices.isEmpty())
     {
-        dev->setSampleRate (sampleRate);
+        const NIDAQ::float64 requestedRate = sampleRate;
+        sampleRate = AIdevices.getFirst()->getCoercedRate (requestedRate);
+        LOGC ("NeuroLayer sample rate: requested ", requestedRate, " S/s, coerced to ", sampleRate, " S/s");
     }
 
-    dev_index = 0;
+    // --- Per-module clocks ---
+    // With "per_group", modules that can sample faster run at the largest integer multiple of the
+    // frame clock they allow, so their frames stay aligned. The master keeps the frame clock,
+    // the modules of a follower are all slaves.
+    std::vector<int> rateFactors;
+    for (auto* dev : AIdevices)
+    {
+        int factor = 1;
+        if (system.module_rates == "per_group" && (isFollower() || dev != AIdevices.getFirst()) && sampleRate > 0)
+        {
+            factor = jmax (1, int (dev->getMaxLineRate() / sampleRate));
+
+            // The driver must hit the multiple exactly, otherwise the frames would drift apart
+            if (factor > 1 && dev->getCoercedRate (sampleRate * factor) != sampleRate * factor)
+            {
+                LOGE (dev->getName(), " cannot run at exactly ", factor, "x the frame clock, using the frame clock");
+                factor = 1;
+            }
+        }
+
+        rateFactors.push_back (factor);
+        dev->setSampleRate (sampleRate * factor);
+    }
 
     // --- Setup DI Devices (rows) ---
-    for (const auto& row : cfg.neuroLayerSystem.rows)
+    dev_index = 0;
+
+    OwnedArray<InputDIChannel> previousDI;
+    previousDI.swapWith (DIdevices);
+
+    for (const auto& row : system.rows)
     {
-        const String moduleName = std::get<0>(row);
-        juce::String portName =  std::get<1>(row);
-        std::cout << moduleName << ": " << dev_index << std::endl; 
-        auto* diDevice = new InputDIChannel(moduleName, portName, dev_index, cfg.neuroLayerSystem.numRows);
-        diDevice->configure();
+        const String moduleName = std::get<0> (row);
+        const juce::String portName = std::get<1> (row);
+
+        InputDIChannel* diDevice = nullptr;
+        for (int i = 0; i < previousDI.size(); i++)
+        {
+            if (previousDI[i]->getName() == moduleName && previousDI[i]->getPort() == portName
+                && previousDI[i]->getDeviceIndex() == dev_index
+                && previousDI[i]->numLines_ == system.numRows)
+            {
+                diDevice = previousDI.removeAndReturn (i);
+                break;
+            }
+        }
+
+        if (diDevice != nullptr)
+        {
+            reused++;
+        }
+        else
+        {
+            std::cout << moduleName << ": " << dev_index << std::endl;
+            diDevice = new InputDIChannel (moduleName, portName, dev_index, system.numRows);
+            configureDevice (diDevice);
+            rebuilt++;
+        }
+
         diDevice->setSampleRate (sampleRate);
-        DIdevices.add(diDevice);
-        dev_index+=1;
-        numProbeRow += cfg.neuroLayerSystem.numRows;
+        DIdevices.add (diDevice);
+        dev_index += 1;
+        numProbeRow += system.numRows;
+    }
+
+    // --- Scan sequence ---
+    // Every probe row, unless the config restricts the scan to a region of interest
+    // or gives an explicit sequence (repeated rows, per-row dwell)
+    const int totalRows = numProbeRow;
+    std::vector<int> scannedRows = validateRows (system.roi_rows, totalRows);
+
+    if (scannedRows.empty())
+    {
+        for (int row = 0; row < totalRows; ++row)
+            scannedRows.push_back (row);
+    }
+    else
+    {
+        LOGC ("NeuroLayer ROI: scanning ", int (scannedRows.size()), " of ", totalRows, " rows");
+    }
+
+    scanSequence = makeScanSequence (scannedRows, oversampling);
+
+    if (! system.scan_sequence.empty())
+    {
+        scanSequence.clear();
+        for (const auto& step : system.scan_sequence)
+        {
+            if (isPositiveAndBelow (step.first, totalRows))
+                scanSequence.push_back ({ step.first, jmax (1, step.second) * oversampling });
+            else
+                LOGE ("Scan sequence row ", step.first, " is outside the probe (", totalRows, " rows), ignored");
+        }
+
+        if (scanSequence.empty())
+            scanSequence = makeScanSequence (scannedRows, oversampling);
+        else
+            LOGC ("NeuroLayer scan sequence: ", int (scanSequence.size()), " steps, ", getSequenceLength (scanSequence), " samples per frame");
+    }
+
+    // Alternative row sets must keep the cells and the frame length, the startup scan is set 0
+    roiSets.assign (1, scanSequence);
+    for (const auto& set : system.roi_sets)
+    {
+        ScanSequence sequence = makeScanSequence (validateRows (set, totalRows), oversampling);
+
+        if (sequence.size() == getSequenceRows (scanSequence).size()
+            && getSequenceLength (sequence) == getSequenceLength (scanSequence))
+            roiSets.push_back (sequence);
+        else
+            LOGE ("ROI set ignored: it does not match the cell count and frame length of the startup scan");
     }
 
     // --- Setup Event Devices ---
-    for (const auto& evt : cfg.eventInputs)
+    OwnedArray<EventDIChannel> previousEvents;
+    previousEvents.swapWith (eventDevices);
+
+    // Event inputs and start pulses are chassis-wide, handled by system 0 only
+    for (const auto& evt : isFollower() ? juce::Array<EventInputConfig>() : cfg.eventInputs)
     {
-        const String moduleName = evt.name;
-        const String digitalLine = evt.digital_line;
-        auto* evDevice = new EventDIChannel (moduleName, digitalLine, evt.oe_event_label);
-        evDevice->configure();
+        EventDIChannel* evDevice = nullptr;
+        for (int i = 0; i < previousEvents.size(); i++)
+        {
+            if (previousEvents[i]->getName() == evt.name && previousEvents[i]->getDigitalLine() == evt.digital_line
+                && previousEvents[i]->event_label_ == evt.oe_event_label)
+            {
+                evDevice = previousEvents.removeAndReturn (i);
+                break;
+            }
+        }
+
+        if (evDevice != nullptr)
+        {
+            reused++;
+        }
+        else
+        {
+            evDevice = new EventDIChannel (evt.name, evt.digital_line, evt.oe_event_label);
+            configureDevice (evDevice);
+            rebuilt++;
+        }
+
         evDevice->setSampleRate (sampleRate);
-        eventDevices.add(evDevice);
+        eventDevices.add (evDevice);
     }
 
     // --- Setup Start Device ---
-    startDevice = new StartChannel(cfg.startEventOutput.name,
-                                   cfg.startEventOutput.digital_line, 
-                                   cfg.startEventOutput.start_time, cfg.startEventOutput.nbr_pulse, cfg.startEventOutput.pulse_duration);
-    
-    startDevice->configure();
-    startDevice->setSampleRate (sampleRate);
+    if (isFollower())
+    {
+        startDevice.reset();
+    }
+    else if (startDevice != nullptr && startDevice->matches (cfg.startEventOutput))
+    {
+        reused++;
+    }
+    else
+    {
+        startDevice = std::make_unique<StartChannel> (cfg.startEventOutput.name,
+                                                      cfg.startEventOutput.digital_line,
+                                                      cfg.startEventOutput.start_time,
+                                                      cfg.startEventOutput.nbr_pulse,
+                                                      cfg.startEventOutput.pulse_duration,
+                                                      cfg.startEventOutput.counter,
+                                                      cfg.startEventOutput.pulse_terminal);
+        configureDevice (startDevice.get());
+        rebuilt++;
+    }
 
+    if (startDevice != nullptr)
+        startDevice->setSampleRate (sampleRate);
 
     // --- Default Voltage Range ---
-    if (!AIdevices.isEmpty())
-        voltageRangeIndex = AIdevices[0]->voltageRanges.size() - 1;
-    else
+    // Keep the current selection if it is still valid for the new modules
+    if (AIdevices.isEmpty())
         voltageRangeIndex = 0;
+    else if (previousCellNumber == 0 || ! isPositiveAndBelow (voltageRangeIndex, AIdevices[0]->voltageRanges.size()))
+        voltageRangeIndex = AIdevices[0]->voltageRanges.size() - 1;
+
+    // --- Demux plan, the kernel is dispatched once per config ---
+    std::vector<int> linesPerModule;
+    for (auto* device : AIdevices)
+        linesPerModule.push_back (device->analogLines_.size());
+
+    ChannelOrder order = ChannelOrder::ColumnMajor;
+    if (system.channel_order == "row_major")
+        order = ChannelOrder::RowMajor;
+    else if (system.channel_order == "probe_map")
+        order = ChannelOrder::Mapped;
+
+    demuxPlan = makeDemuxPlan (linesPerModule, scanSequence, getNsample(), order, system.probe_map, rateFactors);
+    numProbeRow = demuxPlan.numRows;
+
+    roiPlans.clear();
+    for (const auto& sequence : roiSets)
+        roiPlans.push_back (makeDemuxPlan (linesPerModule, sequence, getNsample(), order, system.probe_map, rateFactors));
+
+    // --- Per-cell calibration ---
+    probeRows = totalRows;
+    cellOffset.assign (size_t (numProbeColumn) * probeRows, 0.0f);
+    cellGain.assign (size_t (numProbeColumn) * probeRows, 1.0f);
+    calibrationFile = system.calibration_file.isNotEmpty() ? File (system.calibration_file) : File();
+    calibrationCells = system.calibration;
+    settlingRecords = system.settling_calibration;
+    settlingFile = getSettlingFile (system);
+    calibrationCapture = system.calibration_mode == "capture";
+    calibrationCaptureMs = jmax (0, system.calibration_capture_ms);
+
+    int calibratedCells = 0;
+    for (const auto& cell : system.calibration)
+    {
+        if (! isPositiveAndBelow (cell.column, numProbeColumn) || ! isPositiveAndBelow (cell.row, probeRows)
+            || ! std::isfinite (cell.offset) || ! std::isfinite (cell.gain))
+        {
+            LOGE ("Calibration of cell C", cell.column, ",R", cell.row, " ignored: outside the probe or not finite");
+            continue;
+        }
+
+        cellOffset[size_t (cell.column) * probeRows + cell.row] = cell.offset;
+        cellGain[size_t (cell.column) * probeRows + cell.row] = cell.gain;
+        calibratedCells++;
+    }
+
+    if (calibratedCells > 0)
+        LOGC (systemName, " calibration: ", calibratedCells, " of ", int (cellOffset.size()), " cells from ", calibrationFile.getFullPathName());
+
+    applyCellCalibration();
+
+    // --- Spatial stages ---
+    badCell.assign (cellOffset.size(), false);
+    for (const auto& cell : system.bad_cells)
+    {
+        if (isPositiveAndBelow (cell.first, numProbeColumn) && isPositiveAndBelow (cell.second, probeRows))
+            badCell[size_t (cell.first) * probeRows + cell.second] = true;
+        else
+            LOGE ("Bad cell C", cell.first, ",R", cell.second, " is outside the probe, ignored");
+    }
+
+    buildSpatialPlans (system);
+
+    roiEventMask = isPositiveAndBelow (system.roi_event_label, 64) ? juce::uint64 (1) << system.roi_event_label : 0;
+    demuxKernels = selectDemuxKernels (demuxPlan);
+    LOGD ("Demux kernel: ", demuxKernels.name);
+    LOGD ("Row dwell: ", oversampling, " sample(s), ", demuxPlan.samplesPerFrame, " samples per frame, frame rate ", getFrameRate(), " Hz");
+
+    for (int module = 0; module < demuxPlan.numModules; ++module)
+    {
+        LOGD (AIdevices[module]->getName(), ": ", linesPerModule[module], " line(s) at ", AIdevices[module]->getSampleRate(),
+              " S/s, effective per-cell rate ", getCellRate (module), " S/s");
+    }
+
+    buildSubStreams (system);
+
+    // Fixed discard applies now, "auto" is set by the calibration on the first block
+    if (settlingConfig.mode == "fixed")
+    {
+        for (int module = 0; module < demuxPlan.numModules; ++module)
+            demuxPlan.setSettle (module, settlingConfig.discard_samples);
+    }
+
+    // A stored calibration of the same geometry, dwell and tolerance replaces the measurement, unless
+    // a new one is asked for
+    std::vector<SettlingCalibration> stored;
+    const bool useStored = settlingConfig.mode != "off" && ! settlingConfig.recalibrate;
+    for (int module = 0; useStored && module < demuxPlan.numModules; ++module)
+    {
+        const SettlingRecord key = getSettlingKey (module);
+        const int fixedDiscard = jmin (settlingConfig.discard_samples, demuxPlan.getMinDwell (module) - 1);
+        auto record = std::find_if (settlingRecords.begin(), settlingRecords.end(), [&] (const SettlingRecord& r)
+                                    { return r.hasSameKey (key) && (settlingConfig.mode == "auto" || r.discardSamples == fixedDiscard); });
+
+        if (record == settlingRecords.end())
+        {
+            stored.clear();
+            break;
+        }
+
+        stored.push_back ({ record->discardSamples, record->residualEnergy });
+    }
+
+    for (int module = 0; settlingConfig.mode == "auto" && module < int (stored.size()); ++module)
+        demuxPlan.setSettle (module, stored[module].discardSamples);
+
+    settlingStored = ! stored.empty();
+    if (settlingStored)
+    {
+        LOGC (systemName, " settling: stored calibration from ", settlingFile.getFullPathName());
+    }
+
+    {
+        const ScopedLock lock (statusLock);
+        settlingCalibration = stored;
+    }
+
+    eventMasks.clear();
+    for (auto* device : eventDevices)
+    {
+        if (isPositiveAndBelow (device->event_label_, 64))
+        {
+            eventMasks.push_back (juce::uint64 (1) << device->event_label_);
+        }
+        else
+        {
+            LOGD ("Warning: cannot set event " + device->getName() + " (exceeds the 64 possible events)");
+            eventMasks.push_back (0);
+        }
+    }
+
+    // The drift check needs the shared pulse on one of the event inputs
+    syncMask = 0;
+    for (auto mask : eventMasks)
+    {
+        if (isPositiveAndBelow (chassisConfig.sync_event_label, 64) && mask == juce::uint64 (1) << chassisConfig.sync_event_label)
+            syncMask = mask;
+    }
+
+    if (chassisConfig.sync_event_label >= 0 && syncMask == 0)
+        LOGE ("Chassis sync pulse: no event input with label ", chassisConfig.sync_event_label, ", drift check disabled");
+
+    LOGD ("Config applied: ", reused, " device(s) kept, ", rebuilt, " device(s) rebuilt");
+}
+
+void NeuroProcessor::buildSubStreams (const NeuroLayerSystemConfig& system)
+{
+    // Stream of each column module, -1 until assigned
+    std::vector<int> moduleStream (AIdevices.size(), -1);
+    std::vector<String> names;
+
+    if (! system.stream_groups.isEmpty())
+    {
+        for (const auto& group : system.stream_groups)
+        {
+            const int stream = int (names.size());
+            bool used = false;
+
+            for (const auto& moduleName : group)
+            {
+                int module = -1;
+                for (int i = 0; i < AIdevices.size(); i++)
+                {
+                    if (AIdevices[i]->getName() == moduleName)
+                        module = i;
+                }
+
+                if (module < 0)
+                {
+                    LOGE ("Stream group module ", moduleName, " is not a column module of ", systemName, ", ignored");
+                }
+                else if (moduleStream[module] >= 0)
+                {
+                    LOGE ("Module ", moduleName, " is in several stream groups, kept in the first one");
+                }
+                else
+                {
+                    moduleStream[module] = stream;
+                    used = true;
+                }
+            }
+
+            if (used)
+                names.push_back (systemName + " " + group.joinIntoString ("+"));
+        }
+    }
+    else if (system.stream_split == "module")
+    {
+        for (int module = 0; module < AIdevices.size(); module++)
+        {
+            moduleStream[module] = module;
+            names.push_back (systemName + " " + AIdevices[module]->getName());
+        }
+    }
+
+    // Modules left out of the groups share one more stream
+    const int rest = int (names.size());
+    for (auto& stream : moduleStream)
+    {
+        if (stream < 0)
+            stream = rest;
+    }
+
+    if (rest == 0 || std::find (moduleStream.begin(), moduleStream.end(), rest) != moduleStream.end())
+        names.push_back (rest == 0 ? systemName : systemName + " other");
+
+    subStreams.assign (names.size(), SubStream());
+    for (size_t stream = 0; stream < names.size(); stream++)
+        subStreams[stream].name = names[stream];
+
+    for (int ch = 0; ch < getCellNumber(); ch++)
+        subStreams[moduleStream[demuxPlan.getModule (demuxPlan.outputColumn[ch])]].channels.push_back (ch);
+
+    for (auto& stream : subStreams)
+        stream.runs = makeChannelRuns (stream.channels);
+
+    // Diagnostic stream with the row component removed by the row noise stage, one channel per row
+    if (system.row_noise_stream && ! rowNoisePlans.empty() && rowNoisePlans.front().mode != ReferenceMode::None)
+    {
+        SubStream stream;
+        stream.name = systemName + " row noise";
+        stream.rowNoise = true;
+        for (int row = 0; row < demuxPlan.numRows; row++)
+            stream.channels.push_back (row);
+        subStreams.push_back (stream);
+    }
+
+    if (subStreams.size() > 1)
+    {
+        for (const auto& stream : subStreams)
+            LOGC (stream.name, ": ", int (stream.channels.size()), " channel(s) in ", int (stream.runs.size()), " run(s)");
+    }
+}
+
+void NeuroProcessor::buildSpatialPlans (const NeuroLayerSystemConfig& system)
+{
+    ReferenceMode referenceMode = ReferenceMode::None;
+    if (system.reference == "car" || system.reference == "module_car")
+        referenceMode = ReferenceMode::Mean;
+    else if (system.reference == "row_median")
+        referenceMode = ReferenceMode::Median;
+    else if (system.reference != "none")
+        LOGE ("Unknown reference ", system.reference, ", no referencing");
+
+    ReferenceMode rowNoiseMode = ReferenceMode::None;
+    if (system.row_noise == "mean")
+        rowNoiseMode = ReferenceMode::Mean;
+    else if (system.row_noise == "median")
+        rowNoiseMode = ReferenceMode::Median;
+    else if (system.row_noise != "none")
+        LOGE ("Unknown row noise removal ", system.row_noise, ", rows are kept as they are");
+
+    // A row median reference already removes each row's common component
+    if (rowNoiseMode != ReferenceMode::None && system.reference == "row_median")
+    {
+        LOGE ("Row noise removal and the row_median reference both remove the row component, row noise removal is disabled");
+        rowNoiseMode = ReferenceMode::None;
+    }
+
+    // One plan per row set, since the bad cells depend on the scanned rows
+    referencePlans.clear();
+    rowNoisePlans.clear();
+    laplacianPlans.clear();
+    spatialScratchSize = 0;
+
+    const bool laplacian = system.spatial_filter == "laplacian";
+    if (! laplacian && system.spatial_filter != "none")
+        LOGE ("Unknown spatial filter ", system.spatial_filter, ", no filtering");
+
+    for (const auto& plan : roiPlans)
+    {
+        std::vector<int> channelGroup (plan.numCells, 0);
+
+        // Row noise groups are the scanned rows, so their removed values line up with the row noise stream
+        std::vector<int> rowGroup (plan.numCells, 0);
+        for (int column = 0; column < plan.numColumns; ++column)
+        {
+            for (int row = 0; row < plan.numRows; ++row)
+                rowGroup[plan.outputIndex[column * plan.numRows + row]] = row;
+        }
+
+        for (int ch = 0; ch < plan.numCells; ++ch)
+        {
+            if (badCell[size_t (plan.outputColumn[ch]) * probeRows + plan.outputRow[ch]])
+                channelGroup[ch] = rowGroup[ch] = -1;
+            else if (system.reference == "module_car")
+                channelGroup[ch] = plan.getModule (plan.outputColumn[ch]);
+            else if (system.reference == "row_median")
+                channelGroup[ch] = plan.outputRow[ch];
+        }
+
+        referencePlans.push_back (makeReferencePlan (referenceMode, channelGroup));
+        spatialScratchSize = jmax (spatialScratchSize, referencePlans.back().getScratchSize());
+
+        // Row noise is a reference per row, one removed value per scanned row (0 for rows without two good cells)
+        rowNoisePlans.push_back (makeRowReferencePlan (rowNoiseMode, plan.numColumns, plan.numRows,
+                                                       plan.order == ChannelOrder::ColumnMajor, rowGroup));
+        spatialScratchSize = jmax (spatialScratchSize, rowNoisePlans.back().getScratchSize());
+
+        std::vector<bool> badCells (plan.numCells, false);
+        for (int column = 0; column < plan.numColumns; ++column)
+        {
+            for (int row = 0; row < plan.numRows; ++row)
+                badCells[column * plan.numRows + row] = badCell[size_t (column) * probeRows + plan.scannedRows[row]];
+        }
+
+        // Scanned rows are neighbours only when they are consecutive on the probe
+        std::vector<bool> rowAdjacent (plan.numRows, false);
+        for (int row = 0; row + 1 < plan.numRows; ++row)
+            rowAdjacent[row] = plan.scannedRows[row + 1] == plan.scannedRows[row] + 1;
+
+        laplacianPlans.push_back (makeLaplacianPlan (plan.numColumns, plan.numRows, plan.order == ChannelOrder::ColumnMajor,
+                                                     plan.outputIndex, badCells, rowAdjacent,
+                                                     laplacian ? system.laplacian_weights : std::vector<float>()));
+        spatialScratchSize = jmax (spatialScratchSize, laplacianPlans.back().getScratchSize());
+    }
+
+    if (laplacian)
+        LOGC (systemName, " Laplacian: weights ", system.laplacian_weights[0], ", ", system.laplacian_weights[1],
+              ", ", system.laplacian_weights[2]);
+
+    if (rowNoiseMode != ReferenceMode::None)
+        LOGC (systemName, " row noise removal: ", system.row_noise, " of each row");
+
+    if (referenceMode != ReferenceMode::None)
+        LOGC (systemName, " reference: ", system.reference, ", ", int (referencePlans.front().groups.size()), " group(s)");
+}
+
+void NeuroProcessor::configureDevice (Channel* device)
+{
+    auto cached = capabilityCache.find (device->getName());
+
+    if (cached != capabilityCache.end())
+    {
+        device->configure (cached->second);
+        return;
+    }
+
+    device->configure();
+    capabilityCache[device->getName()] = device->getCapabilities();
+}
+
+void NeuroProcessor::applyRealtimeSettings()
+{
+    RealtimeStatus status;
+    Realtime::applyPriority (realtimeConfig, status);
+    Realtime::applyAffinity (realtimeConfig, status);
+
+    if (! realtimeConfig.lock_memory)
+        status.memoryLock = "disabled";
+
+    LOGC ("NeuroLayer thread priority: ", status.priority);
+    LOGC ("NeuroLayer thread affinity: ", status.affinity);
+
+    const ScopedLock lock (statusLock);
+    realtimeStatus = status;
+}
+
+int NeuroProcessor::getBufferFrames()
+{
+    const int headroomFrames = int (std::ceil (getFrameRate() * bufferConfig.headroom_ms / 1000.0));
+
+    // +1 because the FIFO always keeps one slot empty
+    return getNsample() + std::max (headroomFrames, getNsample()) + 1;
+}
+
+void NeuroProcessor::publishBlock (float* output, int64* sampleNumbers, double* timestamps, uint64* eventCodes, int numFrames)
+{
+    // The streams are filled together, the fullest one limits all of them
+    auto getFreeFrames = [this]
+    {
+        int freeFrames = aiBufferFrames - 1;
+        for (auto* buffer : aiBuffers)
+            freeFrames = jmin (freeFrames, aiBufferFrames - 1 - buffer->getNumSamples());
+        return freeFrames;
+    };
+
+    int freeFrames = getFreeFrames();
+
+    if (overrunPolicy == OverrunPolicy::Block)
+    {
+        while (freeFrames < numFrames && ! shouldStop())
+        {
+            Thread::sleep (1);
+            freeFrames = getFreeFrames();
+        }
+    }
+
+    // drop_oldest keeps the end of the block, drop_newest (and an interrupted block) keeps the start
+    const int count = jlimit (0, numFrames, freeFrames);
+    const int first = overrunPolicy == OverrunPolicy::DropOldest ? numFrames - count : 0;
+    const bool dropped = count < numFrames;
+
+    if (dropped)
+        droppedFrames += numFrames - count;
+
+    if (count == 0)
+    {
+        overrunPending = true;
+        return;
+    }
+
+    // Sample numbers keep counting over dropped frames, the event marks the first frame after the gap
+    if ((overrunPending || (dropped && first > 0)) && isPositiveAndBelow (bufferConfig.overrun_event_label, 64))
+        eventCodes[first] |= juce::uint64 (1) << bufferConfig.overrun_event_label;
+
+    overrunPending = dropped && first == 0;
+
+    const int numCells = getCellNumber();
+
+    for (size_t i = 0; i < subStreams.size(); i++)
+    {
+        const SubStream& stream = subStreams[i];
+        const float* source = output + size_t (first) * numCells;
+        float* data = stream.output;
+
+        if (stream.rowNoise)
+        {
+            data += size_t (first) * stream.channels.size();
+        }
+        else if (data != nullptr)
+        {
+            // Gathers the stream's channels of each frame, one copy per run of consecutive channels
+            const int numChannels = int (stream.channels.size());
+            for (int frame = 0; frame < count; frame++)
+            {
+                const float* in = source + size_t (frame) * numCells;
+                float* out = data + size_t (frame) * numChannels;
+
+                for (const auto& run : stream.runs)
+                    out = std::copy (in + run.first, in + run.first + run.second, out);
+            }
+        }
+
+        aiBuffers[i]->addToBuffer (data != nullptr ? data : output + size_t (first) * numCells,
+                                   sampleNumbers + first,
+                                   timestamps + first,
+                                   eventCodes + first,
+                                   count);
+    }
+}
+
+void NeuroProcessor::setVoltageRange (int index)
+{
+    if (AIdevices.isEmpty() || ! isPositiveAndBelow (index, AIdevices[0]->voltageRanges.size()))
+        return;
+
+    // The running tasks (and the published bitVolts) keep their range until the acquisition stops
+    if (acquiring)
+    {
+        LOGC ("Cannot change the voltage range during acquisition");
+        return;
+    }
+
+    voltageRangeIndex = index;
+
+    try
+    {
+        for (auto* device : AIdevices)
+            device->setVoltageRange (voltageRangeIndex);
+    }
+    catch (const std::exception& e)
+    {
+        // The range is applied again at the next setup
+        LOGD ("Failed to update the voltage range: ");
+        LOGD (e.what());
+        closeTask();
+    }
 }
 
 void Channel::configure()
@@ -119,38 +783,45 @@ void Channel::configure()
     /* Get category type */
     String deviceName = name_;
     LOGD("Device :" + deviceName)
-    NIDAQ::int32 Category;
+    NIDAQ::int32 Category = 0;
     NIDAQ::DAQmxGetDevProductCategory (STR2CHR (deviceName), &Category);
     LOGD ("Product Category: ", Category);
+    capabilities_.productCategory = Category;
 
     int digitalReadSize = 32;
 
-    NIDAQ::uInt32 productNum;
+    NIDAQ::uInt32 productNum = 0;
     NIDAQ::DAQmxGetDevProductNum (STR2CHR (deviceName), &productNum);
     LOGD ("Product Num: ", productNum);
+    capabilities_.productNum = productNum;
 
-    NIDAQ::uInt32 serialNum;
+    NIDAQ::uInt32 serialNum = 0;
     NIDAQ::DAQmxGetDevSerialNum (STR2CHR (deviceName), &serialNum);
     LOGD ("Serial Num: ", serialNum);
+    capabilities_.serialNum = serialNum;
 
     /* Get simultaneous sampling supported */
     NIDAQ::bool32 supported = false;
     NIDAQ::DAQmxGetDevAISimultaneousSamplingSupported (STR2CHR (deviceName), &supported);
     bool simAISamplingSupported = supported;
     LOGD ("Simultaneous sampling supported: ", supported ? "YES" : "NO");
+    capabilities_.simultaneousSampling = simAISamplingSupported;
 
     /* Get device sample rates */
-    NIDAQ::float64 smin;
+    NIDAQ::float64 smin = 0;
     NIDAQ::DAQmxGetDevAIMinRate (STR2CHR (deviceName), &smin);
     LOGD ("Min sample rate: ", smin);
+    capabilities_.minRate = smin;
 
-    NIDAQ::float64 smaxs;
+    NIDAQ::float64 smaxs = 0;
     NIDAQ::DAQmxGetDevAIMaxSingleChanRate (STR2CHR (deviceName), &smaxs);
     LOGD ("Max single channel sample rate: ", smaxs);
+    capabilities_.maxSingleChanRate = smaxs;
 
-    NIDAQ::float64 smaxm;
+    NIDAQ::float64 smaxm = 0;
     NIDAQ::DAQmxGetDevAIMaxMultiChanRate (STR2CHR (deviceName), &smaxm);
     LOGD ("Max multi channel sample rate: ", smaxm);
+    capabilities_.maxMultiChanRate = smaxm;
 
     NIDAQ::float64 data[512];
     NIDAQ::DAQmxGetDevAIVoltageRngs (STR2CHR (deviceName), &data[0], sizeof (data));
@@ -158,11 +829,14 @@ void Channel::configure()
     // Get available voltage ranges
     voltageRanges.clear();
     voltageRanges = { 0.1, 0.2, 0.5, 1, 2, 5, 10 };
+    capabilities_.voltageRanges = voltageRanges;
     
 }
 
-void NeuroProcessor::run()
+bool NeuroProcessor::startAcquisition()
 {
+    acquiring = true;
+
     /**************************************/
     /********CONFIG ANALOG CHANNELS********/
     /**************************************/
@@ -177,36 +851,73 @@ void NeuroProcessor::run()
         char trig_clock_2fs[256] = { "\0" };
         char trig_start[256] = { "\0" };
 
-        // Master: internal clock
-        AIdevices[0]->getClock (trig_clock_fs, trig_clock_2fs, trig_start, getNsample() * CHANNEL_BUFFER_SIZE * 10);
+        // Master: internal clock, exported on the chassis trigger lines
+        // The driver buffers hold the same number of frames whatever the oversampling
+        // A follower system takes the lines exported by system 0 for all its modules
+        if (isFollower())
+        {
+            AIdevices[0]->getTerminalName ("PXI_Trig0", trig_clock_fs);
+            AIdevices[0]->getTerminalName ("PXI_Trig1", trig_clock_2fs);
+        }
+        else
+        {
+            AIdevices[0]->getClock (trig_clock_fs, trig_clock_2fs, trig_start, getNsample() * CHANNEL_BUFFER_SIZE * 10 * demuxPlan.getSamplesPerFrame (0) / getRowNumber(), chassisConfig);
+        }
 
         // Slaves: use master’s clock
-        for (int dev_i = 1; dev_i < AIdevices.size(); dev_i++)
+        for (int dev_i = isFollower() ? 0 : 1; dev_i < AIdevices.size(); dev_i++)
         {
-            AIdevices[dev_i]->setClock (trig_clock_fs, trig_start, getNsample() * CHANNEL_BUFFER_SIZE * 10);
+            AIdevices[dev_i]->setClock (trig_clock_fs,
+                                        trig_start,
+                                        getNsample() * CHANNEL_BUFFER_SIZE * 10 * demuxPlan.getSamplesPerFrame (dev_i) / getRowNumber(),
+                                        demuxPlan.rateFactor[dev_i] > 1);
         }
 
         /************************************/
         /********CONFIG DIGITAL LINES********/
         /************************************/
 
+        // With several row sets the scan is streamed chunk by chunk so it can switch between them
+        rowScanChunkFrames = jmax (1, (getNsample() + rowScanChunks - 1) / rowScanChunks);
         for (int dev_i = 0; dev_i < DIdevices.size(); dev_i++)
         {
-            DIdevices[dev_i]->setup (trig_clock_2fs, trig_start, CHANNEL_BUFFER_SIZE * getNsample(), DIdevices.size());
+            if (isRoiSwitchable())
+                DIdevices[dev_i]->setupStreaming (trig_clock_2fs, trig_start, roiSets, rowScanChunkFrames, getNsample());
+            else
+                DIdevices[dev_i]->setup (trig_clock_2fs, trig_start, CHANNEL_BUFFER_SIZE * getNsample(), scanSequence, rowScanOnboard);
+
+            LOGC ("Row scan ", DIdevices[dev_i]->getName(), ": ", DIdevices[dev_i]->getMemoryStatus());
         }
 
+        // The streamed scan needs its first chunks before the start
+        requestedRoi = 0;
+        rowScanFramesWritten = 0;
+        rowScanSet = 0;
+        rowScanSwitchBlock = -1;
+        processedBlocks = 0;
+        topUpRowScan();
+
         for (int dev_i = 0; dev_i < eventDevices.size(); dev_i++)
         {
-            eventDevices[dev_i]->setup (trig_clock_fs, trig_start, getNsample() * CHANNEL_BUFFER_SIZE * 10);
+            eventDevices[dev_i]->setup (trig_clock_fs, trig_start, getNsample() * CHANNEL_BUFFER_SIZE * 10 * getSamplesPerFrame() / getRowNumber());
         }
-        startDevice->setup (trig_clock_fs, trig_start);
+        if (startDevice != nullptr)
+            startDevice->setup (trig_clock_fs, trig_start);
+
+        // Buffer and transfer tuning of the input tasks, sized per task from its own sample rate
+        for (auto* device : AIdevices)
+            device->applyInputPerformance (performanceConfig, NIDAQ::uInt32 (performanceConfig.input_buffer_ms * 1e-3 * device->getSampleRate()), true);
+
+        for (auto* device : eventDevices)
+            device->applyInputPerformance (performanceConfig, NIDAQ::uInt32 (performanceConfig.input_buffer_ms * 1e-3 * device->getSampleRate()), false);
     }
     catch (const std::exception& e)
     {
         closeTask();
         LOGD ("Failed to setup the device: ");
         LOGD (e.what());
-        return;
+        acquiring = false;
+        return false;
     }
 
     try
@@ -227,7 +938,14 @@ void NeuroProcessor::run()
             device->control();
         }
 
-        startDevice->control();
+        if (startDevice != nullptr)
+            startDevice->control();
+
+        for (auto* device : AIdevices)
+            LOGC ("Input ", device->getName(), ": ", device->describeInputPerformance (true));
+
+        for (auto* device : eventDevices)
+            LOGC ("Events ", device->getName(), ": ", device->describeInputPerformance (false));
 
         for (auto& device : DIdevices)
         {
@@ -239,7 +957,8 @@ void NeuroProcessor::run()
             device->start();
         }
 
-        startDevice->start();
+        if (startDevice != nullptr)
+            startDevice->start();
 
 
         for (int i = 1; i < AIdevices.size(); i++)
@@ -248,6 +967,7 @@ void NeuroProcessor::run()
             AIdevices[i]->start();
         }
 
+        // Starting the master AI task fires the start trigger, so followers must be armed before
         AIdevices[0]->start();
 
     }
@@ -256,84 +976,579 @@ void NeuroProcessor::run()
         LOGD ("Failed to start the device: ");
         LOGD (e.what());
         closeTask();
-        return;
+        acquiring = false;
+        return false;
     }
 
-    double ts;
-
     ai_timestamp = 0;
+    droppedFrames = 0;
+    overrunPending = false;
+    stopRequested = false;
+    realtimeApplied = false;
+    activeRoi = 0;
+    switchRoi (0);
+
+    syncLevel = false;
+    syncFirstSample = -1;
+    syncPulses = 0;
+    syncAligned = true;
+
+    settlingPending = false;
+    for (int module = 0; module < demuxPlan.numModules; ++module)
+        settlingPending |= settlingConfig.mode != "off" && demuxPlan.getMinDwell (module) > 1;
+
+    settlingPending = settlingPending && ! settlingStored;
+    settlingMeasured = false;
 
-    aiBuffer->clear();
+    for (auto* buffer : aiBuffers)
+        buffer->clear();
+
+    // "capture" measures the offsets on the first calibration_capture_ms of the acquisition
+    captureRemaining = calibrationCapture ? jmax<int64> (1, int64 (getFrameRate() * calibrationCaptureMs / 1000.0)) : 0;
+    captureChannelSum.assign (captureRemaining > 0 ? getCellNumber() : 0, 0.0);
+    captureSum.assign (captureRemaining > 0 ? cellOffset.size() : 0, 0.0);
+    captureCount.assign (captureRemaining > 0 ? cellOffset.size() : 0, 0);
+    calibrationCaptured = false;
 
     LOGD ("Start acquisition");
 
     int numDevices = AIdevices.size();
     int nbr_channel = getCellNumber();
-    
+    const int blockFrames = getNsample();
+    const int blockSamples = getSamplesPerFrame() * getNsample(); // event lines, on the frame clock
+
+    // All per-block buffers are carved from one arena allocated for this acquisition
+    size_t arenaBytes = BlockArena::slotSize<float> (size_t (nbr_channel) * blockFrames)
+                        + BlockArena::slotSize<int64> (blockFrames)
+                        + BlockArena::slotSize<double> (blockFrames)
+                        + BlockArena::slotSize<uint64> (blockFrames);
+
+    arenaBytes += BlockArena::slotSize<float> (spatialScratchSize);
+
+    // Split streams gather their channels out of blockOutput, the row noise stream has its own block
+    int dataStreams = 0;
+    for (const auto& stream : subStreams)
+        dataStreams += stream.rowNoise ? 0 : 1;
+
+    const bool split = dataStreams > 1;
+    for (const auto& stream : subStreams)
+        arenaBytes += split || stream.rowNoise ? BlockArena::slotSize<float> (stream.channels.size() * blockFrames) : 0;
+
+    for (int i = 0; i < numDevices; ++i)
+        arenaBytes += BlockArena::slotSize<NIDAQ::float64> (AIdevices[i]->analogLines_.size() * demuxPlan.getLineStride (i));
+
+    arenaBytes += eventDevices.size() * BlockArena::slotSize<NIDAQ::uInt32> (blockSamples);
+
+    arena.allocate (arenaBytes, realtimeConfig.huge_pages);
+
+    blockOutput = arena.carve<float> (size_t (nbr_channel) * blockFrames);
+    blockSampleNumbers = arena.carve<int64> (blockFrames);
+    blockTimestamps = arena.carve<double> (blockFrames);
+    blockEventCodes = arena.carve<uint64> (blockFrames);
+
+    spatialScratch = arena.carve<float> (spatialScratchSize);
+    spatialChunkFrames = getSpatialChunkFrames (nbr_channel, blockFrames);
+
+    rowNoiseOutput = nullptr;
+    for (auto& stream : subStreams)
+    {
+        stream.output = split || stream.rowNoise ? arena.carve<float> (stream.channels.size() * blockFrames) : nullptr;
+        if (stream.rowNoise)
+            rowNoiseOutput = stream.output;
+    }
+
+    dev_ai_data.resize (numDevices);
+    dev_di_event.resize (eventDevices.size());
+
+    for (int i = 0; i < numDevices; ++i)
+        dev_ai_data[i] = arena.carve<NIDAQ::float64> (AIdevices[i]->analogLines_.size() * demuxPlan.getLineStride (i));
+
+    for (int i = 0; i < eventDevices.size(); ++i)
+        dev_di_event[i] = arena.carve<NIDAQ::uInt32> (blockSamples);
+
+    if (arena.getData() == nullptr)
+    {
+        LOGE ("Failed to allocate the acquisition buffers");
+        closeTask (true);
+        acquiring = false;
+        return false;
+    }
+
+    LOGC ("NeuroLayer block arena: ", int64 (arena.getSize() / 1024), " kB on ", arena.getPageTypeName());
+
+    std::fill (blockTimestamps, blockTimestamps + blockFrames, -1.0);
+
+    if (realtimeConfig.lock_memory)
+    {
+        bool memoryLocked = Realtime::lockMemory (arena.getData(), arena.getSize());
+
+        const ScopedLock lock (statusLock);
+        realtimeStatus.memoryLocked = memoryLocked;
+        realtimeStatus.memoryLock = (memoryLocked ? "locked " : "failed to lock ") + String (int64 (arena.getSize() / 1024)) + " kB";
+        LOGC ("NeuroLayer acquisition buffers: ", realtimeStatus.memoryLock);
+    }
+
+    return true;
+}
+
+bool NeuroProcessor::isBlockAvailable()
+{
+    const NIDAQ::uInt32 blockSamples = getSamplesPerFrame() * getNsample();
+
+    for (int i = 0; i < AIdevices.size(); ++i)
+    {
+        if (AIdevices[i]->getAvailableSamples() < demuxPlan.getLineStride (i))
+            return false;
+    }
+
+    for (auto* device : eventDevices)
+    {
+        if (device->getAvailableSamples() < blockSamples)
+            return false;
+    }
+
+    return true;
+}
+
+void NeuroProcessor::processBlock()
+{
+    const int blockFrames = demuxPlan.blockFrames;
+    const int blockSamples = getSamplesPerFrame() * blockFrames;
+
+    for (int i = 0; i < AIdevices.size(); ++i)
+    {
+        AIdevices[i]->acquire (dev_ai_data[i], int (demuxPlan.getLineStride (i)));
+    }
+
+    for (int i = 0; i < eventDevices.size(); ++i)
+    {
+        eventDevices[i]->acquire (dev_di_event[i], blockSamples);
+    }
+
+    // The row set of this block was chosen when its first chunk was written to the DO tasks
+    const bool roiSwitched = isRoiSwitchable() && rowScanSwitchBlock == processedBlocks;
+    if (roiSwitched)
+    {
+        switchRoi (rowScanSet);
+        rowScanSwitchBlock = -1;
+    }
+    processedBlocks++;
+
+    if (settlingPending)
+        calibrateSettling();
+
+    // The demux and the spatial stages run chunk by chunk, while the chunk's cells are still in cache
+    const int numCells = getCellNumber();
+    for (int first = 0; first < blockFrames; first += spatialChunkFrames)
+    {
+        const int frames = jmin (spatialChunkFrames, blockFrames - first);
+        float* chunk = blockOutput + size_t (first) * numCells;
+
+        demuxKernels.demux (demuxPlan, dev_ai_data.data(), blockOutput, first, frames);
+
+        if (captureRemaining > 0)
+            captureCalibration (chunk, frames);
+
+        applyReference (rowNoisePlans[activeRoi], chunk, frames, spatialScratch,
+                        rowNoiseOutput != nullptr ? rowNoiseOutput + size_t (first) * demuxPlan.numRows : nullptr);
+        applyReference (referencePlans[activeRoi], chunk, frames, spatialScratch);
+        applyLaplacian (laplacianPlans[activeRoi], chunk, frames, spatialScratch);
+
+        // The DO lead is short, keep it topped up while the block is processed
+        topUpRowScan();
+    }
+
+    std::fill (blockEventCodes, blockEventCodes + blockFrames, 0);
+    for (int i = 0; i < eventDevices.size(); ++i)
+    {
+        if (eventMasks[i] != 0)
+            demuxKernels.events (dev_di_event[i], getSamplesPerFrame(), blockFrames, eventMasks[i], blockEventCodes);
+    }
+
+    if (syncMask != 0)
+        checkChassisSync();
+
+    if (roiSwitched)
+    {
+        blockEventCodes[0] |= roiEventMask;
+        LOGC ("NeuroLayer ROI set ", activeRoi, " active from sample ", ai_timestamp + 1);
+    }
+
+    topUpRowScan();
+
+    for (int nsample = 0; nsample < blockFrames; ++nsample)
+        blockSampleNumbers[nsample] = ++ai_timestamp;
+
+    publishBlock (blockOutput, blockSampleNumbers, blockTimestamps, blockEventCodes, blockFrames);
+}
+
+std::vector<int> NeuroProcessor::validateRows (const Array<int>& rows, int totalRows)
+{
+    std::vector<int> valid;
+
+    for (int row : rows)
+    {
+        if (! isPositiveAndBelow (row, totalRows))
+        {
+            LOGE ("ROI row ", row, " is outside the probe (", totalRows, " rows), ignored");
+        }
+        else if (std::find (valid.begin(), valid.end(), row) == valid.end())
+        {
+            valid.push_back (row);
+        }
+    }
+
+    std::sort (valid.begin(), valid.end());
+    return valid;
+}
+
+void NeuroProcessor::requestRoi (int set)
+{
+    if (! isPositiveAndBelow (set, int (roiSets.size())))
+    {
+        LOGE ("Unknown ROI set ", set, " (", int (roiSets.size()), " configured)");
+        return;
+    }
+
+    requestedRoi = set;
+}
+
+void NeuroProcessor::switchRoi (int set)
+{
+    // Same geometry, so the kernels stay valid; the settling calibration carries over
+    auto& plan = roiPlans[set];
+    for (int module = 0; module < plan.numModules; ++module)
+        plan.setSettle (module, demuxPlan.settleSamples[module]);
+
+    demuxPlan = plan;
+    activeRoi = set;
+}
+
+void NeuroProcessor::topUpRowScan()
+{
+    if (! isRoiSwitchable() || DIdevices.isEmpty())
+        return;
+
+    const int blockFrames = getNsample();
+    const int64 leadFrames = int64 (rowScanLeadChunks) * rowScanChunkFrames;
+
     try
     {
-        while (! threadShouldExit())
+        // All DO tasks share the 2*Fs clock and hold the same number of frames
+        while (DIdevices[0]->getQueuedFrames() < leadFrames)
         {
+            const int64 block = rowScanFramesWritten / blockFrames;
+            const int offset = int (rowScanFramesWritten % blockFrames);
 
-            HeapBlock<float> output;
-            output.allocate (nbr_channel, true);
-            std::vector<std::vector<NIDAQ::float64>> dev_ai_data (numDevices);
-            std::vector<std::vector<NIDAQ::uInt32>> dev_di_event (eventDevices.size());
-            
-             for (size_t i = 0; i < numDevices; ++i)
+            if (offset == 0 && rowScanSwitchBlock < 0 && requestedRoi.load() != rowScanSet)
             {
-                AIdevices[i]->acquire (&dev_ai_data[i], CHANNEL_BUFFER_SIZE * getNsample());
+                rowScanSet = requestedRoi.load();
+                rowScanSwitchBlock = block;
             }
 
-             for (size_t i = 0; i < eventDevices.size(); ++i)
+            const int frames = jmin (rowScanChunkFrames, blockFrames - offset);
+            for (auto* device : DIdevices)
+                device->writeFrames (rowScanSet, frames);
+            rowScanFramesWritten += frames;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOGE ("NeuroLayer row scan stopped: ", e.what(), ". Processing fell more than ", leadFrames,
+              " frames behind the scan, the acquisition stops");
+        throw;
+    }
+}
+
+void NeuroProcessor::calibrateSettling()
+{
+    settlingPending = false;
+
+    const bool automatic = settlingConfig.mode == "auto";
+    auto calibration = ::calibrateSettling (demuxPlan,
+                                            dev_ai_data.data(),
+                                            settlingConfig.tolerance_mv / 1000.0,
+                                            automatic ? -1 : settlingConfig.discard_samples);
+
+    for (int module = 0; module < int (calibration.size()); ++module)
+    {
+        if (automatic)
+            demuxPlan.setSettle (module, calibration[module].discardSamples);
+
+        LOGC ("NeuroLayer settling ", AIdevices[module]->getName(), ": discarding ", calibration[module].discardSamples,
+              " of ", demuxPlan.getMinDwell (module), " samples, residual ", calibration[module].residualEnergy * 1.0e12, " uV^2");
+    }
+
+    settlingMeasured = true;
+
+    const ScopedLock lock (statusLock);
+    settlingCalibration = calibration;
+}
+
+SettlingRecord NeuroProcessor::getSettlingKey (int module)
+{
+    SettlingRecord key;
+    key.module = module;
+    key.lines = demuxPlan.linesPerModule[module];
+    key.rows = demuxPlan.numRows;
+    key.dwell = demuxPlan.getMinDwell (module);
+    key.tolerance_mv = settlingConfig.tolerance_mv;
+    return key;
+}
+
+void NeuroProcessor::applyCellCalibration()
+{
+    setCellCalibration (demuxPlan, cellOffset, cellGain, probeRows);
+
+    for (auto& plan : roiPlans)
+        setCellCalibration (plan, cellOffset, cellGain, probeRows);
+}
+
+void NeuroProcessor::captureCalibration (const float* chunk, int numFrames)
+{
+    const int numCells = getCellNumber();
+    const int frames = int (jmin<int64> (captureRemaining, numFrames));
+
+    // Frame-major, like the block, then one update per cell
+    std::fill (captureChannelSum.begin(), captureChannelSum.end(), 0.0);
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        const float* cells = chunk + size_t (frame) * numCells;
+        for (int ch = 0; ch < numCells; ++ch)
+            captureChannelSum[ch] += cells[ch];
+    }
+
+    for (int ch = 0; ch < numCells; ++ch)
+    {
+        const size_t cell = size_t (demuxPlan.outputColumn[ch]) * probeRows + demuxPlan.outputRow[ch];
+        captureSum[cell] += captureChannelSum[ch];
+        captureCount[cell] += frames;
+    }
+
+    captureRemaining -= frames;
+    if (captureRemaining > 0)
+        return;
+
+    // The baseline was measured with the current calibration, so it is the remaining offset
+    double meanOffset = 0;
+    int captured = 0;
+    for (size_t cell = 0; cell < cellOffset.size(); ++cell)
+    {
+        if (captureCount[cell] == 0 || cellGain[cell] == 0)
+            continue;
+
+        const double residual = captureSum[cell] / captureCount[cell] / cellGain[cell];
+        cellOffset[cell] += float (residual);
+        meanOffset += std::abs (cellOffset[cell]);
+        captured++;
+    }
+
+    applyCellCalibration();
+    calibrationCaptured = true;
+
+    LOGC (systemName, " calibration: offsets of ", captured, " cells captured, mean |offset| ",
+          captured > 0 ? meanOffset / captured * 1000.0 : 0.0, " mV");
+}
+
+void NeuroProcessor::checkChassisSync()
+{
+    const double expectedFrames = chassisConfig.sync_period_s * getFrameRate();
+
+    // Pulses are only seen on whole frames, so a fractional period alone moves them by up to a frame
+    const double tolerance = jmax (1, chassisConfig.sync_tolerance_frames) + (expectedFrames - std::floor (expectedFrames));
+
+    for (int frame = 0; frame < demuxPlan.blockFrames; ++frame)
+    {
+        const bool level = (blockEventCodes[frame] & syncMask) != 0;
+        const bool risingEdge = level && ! syncLevel;
+        syncLevel = level;
+
+        if (! risingEdge)
+            continue;
+
+        const int64 sample = ai_timestamp + frame + 1;
+
+        if (syncFirstSample < 0)
+        {
+            syncFirstSample = sample;
+            syncPulses = 0;
+            continue;
+        }
+
+        // Offset of this pulse from where a drift-free clock would put it, accumulated since the first one
+        ++syncPulses;
+        const double nominal = syncPulses * expectedFrames;
+        const double offset = double (sample - syncFirstSample) - nominal;
+        const bool aligned = std::abs (offset) <= tolerance;
+
+        if (syncPulses % 60 == 0)
+            LOGD ("NeuroLayer chassis sync: offset ", offset, " frame(s) after ", syncPulses, " pulses");
+
+        if (aligned != syncAligned)
+        {
+            if (aligned)
             {
-                eventDevices[i]->acquire (&dev_di_event[i], getNsample() * CHANNEL_BUFFER_SIZE);
+                LOGC ("NeuroLayer chassis sync recovered, offset ", offset, " frame(s)");
             }
-             for (int nsample = 0; nsample < getNsample(); ++nsample)
+            else
             {
-                int writeIdx = 0;
-                for (int station = 0; station < numDevices; ++station)
-                {
-                    for (int analogch = 0; analogch < AIdevices[station]->analogLines_.size(); ++analogch)
-                    {
-                        for (int ch = 0; ch < getRowNumber(); ++ch)
-                            output[writeIdx++] = dev_ai_data[station][ch + analogch * getRowNumber() * getNsample() + nsample * getRowNumber()]; // step per sample
-                    }
-                }
-                juce::uint64 eventCode = 0;
+                LOGE ("NeuroLayer chassis sync lost: pulse ", syncPulses, " is ", offset, " frame(s) off, drift ",
+                      offset / nominal * 1.0e6, " ppm");
+            }
+            syncAligned = aligned;
+        }
+    }
+}
 
-                for (size_t i = 0; i < eventDevices.size(); ++i)
-                {
-                    bool isActive = std::accumulate (
-                                        dev_di_event[i].begin() + nsample * CHANNEL_BUFFER_SIZE,
-                                        dev_di_event[i].begin() + (nsample + 1) * CHANNEL_BUFFER_SIZE,
-                                        0.0)
-                                    > 0;
-
-                    if (isActive)
-                    {
-                        if (eventDevices[i]->event_label_ < 64)
-                            eventCode |= (juce::uint64 (1) << eventDevices[i]->event_label_); // cast avant le shift
-                        else
-                            LOGD ("Warning: cannot set event " + std::to_string(i) + " (exceeds the 64 possible events)");
-                    }
-                }
+bool NeuroProcessor::pollBlock()
+{
+    if (! realtimeApplied)
+    {
+        applyRealtimeSettings();
+        realtimeApplied = true;
+    }
 
-                ai_timestamp++;
-                aiBuffer->addToBuffer (output, &ai_timestamp, &ts, &eventCode, 1);
-            }
+    try
+    {
+        if (! isBlockAvailable())
+        {
+            topUpRowScan();
+            Thread::sleep (1);
+            return true;
         }
+
+        processBlock();
     }
-        catch (const std::exception& e)
+    catch (const std::exception& e)
     {
         LOGD ("Error during acquisition: ");
         LOGD (e.what());
-        
+        return false;
+    }
+
+    return true;
+}
+
+void NeuroProcessor::stopAcquisition()
+{
+    if (droppedFrames > 0)
+        LOGC ("NeuroLayer dropped ", droppedFrames.load(), " frame(s), overrun policy: ", bufferConfig.overrun_policy);
+
+    if (realtimeConfig.lock_memory)
+        Realtime::unlockMemory (arena.getData(), arena.getSize());
+
+    arena.release();
+    dev_ai_data.clear();
+    dev_di_event.clear();
+    blockOutput = nullptr;
+    spatialScratch = nullptr;
+    rowNoiseOutput = nullptr;
+
+    for (auto& stream : subStreams)
+        stream.output = nullptr;
+
+    // Channel names describe the startup row set
+    if (isRoiSwitchable() && activeRoi != 0)
+        switchRoi (0);
+
+    armed = false;
+    closeTask (true);
+    acquiring = false;
+}
+
+void NeuroProcessor::writeCalibration()
+{
+    if (calibrationCaptured)
+    {
+        calibrationCells.clear();
+        for (int column = 0; column < numProbeColumn; ++column)
+        {
+            for (int row = 0; row < probeRows; ++row)
+            {
+                const size_t cell = size_t (column) * probeRows + row;
+                calibrationCells.push_back ({ column, row, cellOffset[cell], cellGain[cell] });
+            }
+        }
     }
-    // fflush(stdout);
-    closeTask();
 
+    // The settling records replace those of the same key, other geometries are kept
+    if (settlingMeasured)
+    {
+        const auto calibration = getSettlingCalibration();
+        for (int module = 0; module < int (calibration.size()); ++module)
+        {
+            SettlingRecord record = getSettlingKey (module);
+            record.discardSamples = calibration[module].discardSamples;
+            record.residualEnergy = calibration[module].residualEnergy;
+
+            auto stored = std::find_if (settlingRecords.begin(), settlingRecords.end(),
+                                        [&] (const SettlingRecord& r) { return r.hasSameKey (record); });
+            if (stored != settlingRecords.end())
+                *stored = record;
+            else
+                settlingRecords.push_back (record);
+        }
 
+        settlingStored = ! settlingConfig.recalibrate;
+        if (settlingFile == File())
+        {
+            LOGD (systemName, " settling calibration not stored: no calibration_file");
+        }
+    }
 
-    return;
-}
\ No newline at end of file
+    // "capture" owns the calibration file, which then holds the settling records too. Otherwise the
+    // table is the user's and only the settling records are written, to their own file.
+    if (calibrationCapture && calibrationFile != File() && (calibrationCaptured || settlingMeasured))
+    {
+        if (saveCalibration (calibrationFile, calibrationCells, settlingRecords))
+            LOGC (systemName, " calibration written to ", calibrationFile.getFullPathName());
+    }
+    else if (! calibrationCapture && settlingMeasured && settlingFile != File())
+    {
+        if (saveCalibration (settlingFile, {}, settlingRecords))
+            LOGC (systemName, " settling calibration written to ", settlingFile.getFullPathName());
+    }
+
+    calibrationCaptured = false;
+    settlingMeasured = false;
+}
+
+bool NeuroProcessor::arm()
+{
+    armed = startAcquisition();
+    return armed;
+}
+
+void NeuroProcessor::run()
+{
+    if (! armed && ! startAcquisition())
+        return;
+
+    armed = false;
+
+    applyRealtimeSettings();
+    realtimeApplied = true;
+
+    try
+    {
+        while (! shouldStop())
+        {
+            // A streamed row scan is topped up while waiting, so the blocking reads are replaced by polling
+            if (isRoiSwitchable() && ! isBlockAvailable())
+            {
+                topUpRowScan();
+                Thread::sleep (1);
+                continue;
+            }
+
+            processBlock();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOGD ("Error during acquisition: ");
+        LOGD (e.what());
+    }
+
+    stopAcquisition();
+}
@@ -25,10 +25,15 @@
 
 
 #include <DataThreadHeaders.h>
+#include <array>
 #include <stdexcept>
 #include <string>
 #include <vector>
+#include "BlockArena.h"
 #include "NeuroConfig.h"
+#include "NeuroDemux.h"
+#include "NeuroSpatial.h"
+#include "RealtimeScheduling.h"
 #include "nidaq-api/NIDAQmx.h"
 
 #define ERR_BUFF_SIZE 2048
@@ -68,6 +73,68 @@ inline static int32 GetTerminalNameWithDevPrefix (NIDAQ::TaskHandle taskHandle,
     return error;
 }
 
+/* ================================================================
+   Device capabilities, queried once per module
+   ================================================================ */
+struct DeviceCapabilities
+{
+    NIDAQ::int32 productCategory = 0;
+    NIDAQ::uInt32 productNum = 0;
+    NIDAQ::uInt32 serialNum = 0;
+    bool simultaneousSampling = false;
+    NIDAQ::float64 minRate = 0;
+    NIDAQ::float64 maxSingleChanRate = 0;
+    NIDAQ::float64 maxMultiChanRate = 0;
+    Array<float> voltageRanges;
+};
+
+/* ================================================================
+   Performance options, config names of the DAQmx values
+   ================================================================ */
+struct DAQmxOption
+{
+    const char* name;
+    NIDAQ::int32 value;
+};
+
+static const DAQmxOption transferMechanisms[] = {
+    { "dma", DAQmx_Val_DMA },
+    { "interrupts", DAQmx_Val_Interrupts },
+    { "programmed_io", DAQmx_Val_ProgrammedIO },
+    { "usb_bulk", DAQmx_Val_USBbulk },
+};
+
+static const DAQmxOption requestConditions[] = {
+    { "not_empty", DAQmx_Val_OnBrdMemNotEmpty },
+    { "more_than_half_full", DAQmx_Val_OnBrdMemMoreThanHalfFull },
+};
+
+static const DAQmxOption readWaitModes[] = {
+    { "wait_for_interrupt", DAQmx_Val_WaitForInterrupt },
+    { "poll", DAQmx_Val_Poll },
+    { "yield", DAQmx_Val_Yield },
+    { "sleep", DAQmx_Val_Sleep },
+};
+
+/** DAQmx value of a config name, 0 for "default" and unknown names */
+template <size_t N>
+inline NIDAQ::int32 findDAQmxOption (const DAQmxOption (&options)[N], const String& name)
+{
+    for (const auto& option : options)
+        if (name == option.name)
+            return option.value;
+    return 0;
+}
+
+template <size_t N>
+inline String getDAQmxOptionName (const DAQmxOption (&options)[N], NIDAQ::int32 value)
+{
+    for (const auto& option : options)
+        if (value == option.value)
+            return option.name;
+    return String (value);
+}
+
 /* ================================================================
    Base Channel class
    ================================================================ */
@@ -82,11 +149,22 @@ public:
     Channel& operator= (const Channel&) = delete;
 
     String getName() const { return name_; }
+    int getDeviceIndex() const { return dev_index_; }
+    /** Device-prefixed name of a terminal (e.g. "PXI_Trig0") as seen from this channel's task */
+    void getTerminalName (const char terminalName[], char* triggerName) { GetTerminalNameWithDevPrefix (taskHandle_, terminalName, triggerName); }
 
+    /** Queries the module capabilities from the driver */
     void configure();
+    /** Reuses capabilities already queried for the same module */
+    void configure (const DeviceCapabilities& capabilities)
+    {
+        capabilities_ = capabilities;
+        voltageRanges = capabilities.voltageRanges;
+    }
+    const DeviceCapabilities& getCapabilities() const { return capabilities_; }
 
-    int getSampleRate() const { return sampleRate_; }
-    void setSampleRate (int sampleRate) { sampleRate_ = sampleRate; }
+    NIDAQ::float64 getSampleRate() const { return sampleRate_; }
+    void setSampleRate (NIDAQ::float64 sampleRate) { sampleRate_ = sampleRate; }
 
     virtual void start()
     {
@@ -102,6 +180,15 @@ public:
 
     }
 
+    /** Samples per channel already acquired and not yet read */
+    NIDAQ::uInt32 getAvailableSamples()
+    {
+        NIDAQ::uInt32 available = 0;
+        if (taskHandle_ != 0)
+            DAQmxCheck (NIDAQ::DAQmxGetReadAvailSampPerChan (taskHandle_, &available));
+        return available;
+    }
+
     virtual void control()
     {
         if (taskHandle_ != 0)
@@ -111,6 +198,67 @@ public:
             DAQmxCheck (NIDAQ::DAQmxTaskControl (counterTask, DAQmx_Val_Task_Commit));
     }
 
+    /** Applies the performance section to the input task before it is committed. "default" entries
+        reset the property, since the AI tasks are kept between acquisitions. bufferSamples of 0 keeps
+        the buffer size derived from the sample clock timing. */
+    void applyInputPerformance (const PerformanceConfig& performance, NIDAQ::uInt32 bufferSamples, bool analog)
+    {
+        if (taskHandle_ == 0)
+            return;
+
+        if (bufferSamples > 0)
+            DAQmxCheck (NIDAQ::DAQmxCfgInputBuffer (taskHandle_, bufferSamples));
+        else
+            DAQmxCheck (NIDAQ::DAQmxResetBufInputBufSize (taskHandle_));
+
+        const NIDAQ::int32 mechanism = findDAQmxOption (transferMechanisms, performance.transfer_mechanism);
+        if (mechanism != 0)
+            DAQmxCheck (analog ? NIDAQ::DAQmxSetAIDataXferMech (taskHandle_, "", mechanism)
+                               : NIDAQ::DAQmxSetDIDataXferMech (taskHandle_, "", mechanism));
+        else
+            DAQmxCheck (analog ? NIDAQ::DAQmxResetAIDataXferMech (taskHandle_, "")
+                               : NIDAQ::DAQmxResetDIDataXferMech (taskHandle_, ""));
+
+        const NIDAQ::int32 condition = findDAQmxOption (requestConditions, performance.request_condition);
+        if (condition != 0)
+            DAQmxCheck (analog ? NIDAQ::DAQmxSetAIDataXferReqCond (taskHandle_, "", condition)
+                               : NIDAQ::DAQmxSetDIDataXferReqCond (taskHandle_, "", condition));
+        else
+            DAQmxCheck (analog ? NIDAQ::DAQmxResetAIDataXferReqCond (taskHandle_, "")
+                               : NIDAQ::DAQmxResetDIDataXferReqCond (taskHandle_, ""));
+
+        const NIDAQ::int32 waitMode = findDAQmxOption (readWaitModes, performance.read_wait_mode);
+        if (waitMode != 0)
+            DAQmxCheck (NIDAQ::DAQmxSetReadWaitMode (taskHandle_, waitMode));
+        else
+            DAQmxCheck (NIDAQ::DAQmxResetReadWaitMode (taskHandle_));
+    }
+
+    /** Buffer and transfer settings the driver settled on, read back once the task is committed */
+    String describeInputPerformance (bool analog)
+    {
+        NIDAQ::uInt32 bufferSize = 0;
+        NIDAQ::int32 mechanism = 0, condition = 0, waitMode = 0;
+
+        try
+        {
+            DAQmxCheck (NIDAQ::DAQmxGetBufInputBufSize (taskHandle_, &bufferSize));
+            DAQmxCheck (analog ? NIDAQ::DAQmxGetAIDataXferMech (taskHandle_, "", &mechanism)
+                               : NIDAQ::DAQmxGetDIDataXferMech (taskHandle_, "", &mechanism));
+            DAQmxCheck (analog ? NIDAQ::DAQmxGetAIDataXferReqCond (taskHandle_, "", &condition)
+                               : NIDAQ::DAQmxGetDIDataXferReqCond (taskHandle_, "", &condition));
+            DAQmxCheck (NIDAQ::DAQmxGetReadWaitMode (taskHandle_, &waitMode));
+        }
+        catch (const std::exception& e)
+        {
+            return "unavailable (" + String (e.what()) + ")";
+        }
+
+        return String (bufferSize) + " samples/channel, " + getDAQmxOptionName (transferMechanisms, mechanism)
+               + ", request " + getDAQmxOptionName (requestConditions, condition)
+               + ", wait " + getDAQmxOptionName (readWaitModes, waitMode);
+    }
+
     virtual void stop()
     {
         if (taskHandle_)
@@ -135,8 +283,9 @@ public:
     Array<float> voltageRanges;
 
 protected:
+    DeviceCapabilities capabilities_;
     String name_;
-    int sampleRate_ { 0 };
+    NIDAQ::float64 sampleRate_ { 0 };
     NIDAQ::TaskHandle taskHandle_ { 0 };
     NIDAQ::TaskHandle counterTask { 0 };
     int dev_index_ = 0;
@@ -153,6 +302,13 @@ public:
 
     void setup (int voltageRangeIndex)
     {
+        // The AI task is kept between acquisitions, only its range needs refreshing
+        if (taskHandle_ != 0)
+        {
+            setVoltageRange (voltageRangeIndex);
+            return;
+        }
+
         DAQmxCheck (NIDAQ::DAQmxCreateTask (STR2CHR ("AITask_" + name_), &taskHandle_));
 
         for (const auto& analogLine : analogLines_)
@@ -167,9 +323,116 @@ public:
                 DAQmx_Val_Volts,
                 nullptr));
         }
+        currentRangeIndex_ = voltageRangeIndex;
+    }
+
+    /** Reconfigures AI.Min/Max of the existing task, without recreating it.
+        Returns false if there is no task yet (the range is applied at the next setup). */
+    bool setVoltageRange (int voltageRangeIndex)
+    {
+        if (taskHandle_ == 0)
+            return false;
+
+        if (voltageRangeIndex == currentRangeIndex_)
+            return true;
+
+        const float range = voltageRanges[voltageRangeIndex];
+        DAQmxCheck (NIDAQ::DAQmxSetAIMax (taskHandle_, "", range));
+        DAQmxCheck (NIDAQ::DAQmxSetAIMin (taskHandle_, "", -range));
+        currentRangeIndex_ = voltageRangeIndex;
+        return true;
+    }
+
+    /** Fastest rate each line can be sampled at: the per-channel rate of a simultaneous-sampling
+        module, or the aggregate rate shared between the lines of a multiplexed one.
+        Falls back to a 500 kS/s aggregate when the driver reported no rates. */
+    NIDAQ::float64 getMaxLineRate() const
+    {
+        const int numLines = jmax (1, analogLines_.size());
+
+        if (capabilities_.maxMultiChanRate <= 0)
+            return 500000.0 / numLines;
+
+        if (capabilities_.simultaneousSampling)
+            return capabilities_.maxMultiChanRate;
+
+        NIDAQ::float64 rate = capabilities_.maxMultiChanRate / numLines;
+        if (capabilities_.maxSingleChanRate > 0)
+            rate = jmin (rate, capabilities_.maxSingleChanRate);
+        return rate;
+    }
+
+    /** Rate the driver actually uses when asked for rate on the onboard clock, read back with
+        DAQmxGetSampClkRate on a temporary task. Returns rate unchanged if the query fails. */
+    NIDAQ::float64 getCoercedRate (NIDAQ::float64 rate)
+    {
+        NIDAQ::TaskHandle rateTask = 0;
+        NIDAQ::float64 coerced = rate;
+
+        try
+        {
+            DAQmxCheck (NIDAQ::DAQmxCreateTask (STR2CHR ("AIRateTask_" + name_), &rateTask));
+
+            for (const auto& analogLine : analogLines_)
+            {
+                DAQmxCheck (NIDAQ::DAQmxCreateAIVoltageChan (rateTask,
+                                                             STR2CHR (name_ + "/" + analogLine),
+                                                             "",
+                                                             DAQmx_Val_Diff,
+                                                             -voltageRanges.getLast(),
+                                                             voltageRanges.getLast(),
+                                                             DAQmx_Val_Volts,
+                                                             nullptr));
+            }
+
+            DAQmxCheck (NIDAQ::DAQmxCfgSampClkTiming (rateTask, "", rate, DAQmx_Val_Rising, DAQmx_Val_ContSamps, 1000));
+            DAQmxCheck (NIDAQ::DAQmxGetSampClkRate (rateTask, &coerced));
+        }
+        catch (const std::exception& e)
+        {
+            LOGE ("Could not read back the sample rate of ", name_, ": ", e.what());
+            coerced = rate;
+        }
+
+        if (rateTask != 0)
+            NIDAQ::DAQmxClearTask (rateTask);
+
+        return coerced;
+    }
+
+    /** Stops the acquisition and clears the clock counter, but keeps the AI task for the next run */
+    void pause()
+    {
+        disconnectRoutes();
+
+        if (taskHandle_)
+        {
+            NIDAQ::DAQmxStopTask (taskHandle_);
+            NIDAQ::DAQmxTaskControl (taskHandle_, DAQmx_Val_Task_Unreserve);
+        }
+
+        if (counterTask)
+        {
+            NIDAQ::DAQmxStopTask (counterTask);
+            NIDAQ::DAQmxClearTask (counterTask);
+            counterTask = 0;
+        }
     }
-    void getClock (char* trig_name_di, char* trig_name_do, char* trig_name_start, int bufferSize) 
+
+    void stop() override
     {
+        disconnectRoutes();
+        Channel::stop();
+    }
+
+    /** Makes this task the clock master of the chassis: sample clock on PXI_Trig0, 2*Fs on PXI_Trig1,
+        start trigger on PXI_Trig2. Across chassis, a "master" also routes the 10 MHz reference and its
+        start trigger to PFI lines, and a "slave" locks its timebase to the imported reference and
+        waits for the imported start trigger, so both chassis count the same frames. */
+    void getClock (char* trig_name_di, char* trig_name_do, char* trig_name_start, int bufferSize, const ChassisConfig& chassis = ChassisConfig())
+    {
+        resetClock();
+
         GetTerminalNameWithDevPrefix (taskHandle_, "PXI_Trig0", trig_name_di);
 
         std::cout << "set clock " << name_ << "; " <<dev_index_ << std::endl;
@@ -181,13 +444,23 @@ public:
                                       DAQmx_Val_ContSamps,
                                       bufferSize);
 
+        char refClock[256] = { "\0" };
+        char chassisTerm[256] = { "\0" };
+
+        if (chassis.mode == "slave")
+        {
+            GetTerminalNameWithDevPrefix (taskHandle_, STR2CHR (chassis.ref_clock_terminal), refClock);
+            DAQmxCheck (NIDAQ::DAQmxSetRefClkSrc (taskHandle_, refClock));
+            DAQmxCheck (NIDAQ::DAQmxSetRefClkRate (taskHandle_, 10.0e6));
+        }
+
         NIDAQ::DAQmxExportSignal (taskHandle_, DAQmx_Val_SampleClock, trig_name_di);
         //used to debug the Clock signal
         
         char trig_demo[256] = { "\0" };
         GetTerminalNameWithDevPrefix (taskHandle_, "PFI0", trig_demo);
         std::cout << "export the clocks: " << trig_demo << std::endl;
-        NIDAQ::DAQmxConnectTerms (trig_name_di, trig_demo, DAQmx_Val_DoNotInvertPolarity);
+        connectRoute (trig_name_di, trig_demo);
 
 
         DAQmxCheck (NIDAQ::DAQmxCreateTask (STR2CHR ("CounterClockTask" + name_), &counterTask));
@@ -208,12 +481,19 @@ public:
         // Configure for continuous pulse generation
         NIDAQ::DAQmxCfgImplicitTiming (counterTask, DAQmx_Val_ContSamps, 1000);
 
+        // The 2*Fs row clock must follow the master chassis timebase as well, not the local oscillator
+        if (chassis.mode == "slave")
+        {
+            DAQmxCheck (NIDAQ::DAQmxSetRefClkSrc (counterTask, refClock));
+            DAQmxCheck (NIDAQ::DAQmxSetRefClkRate (counterTask, 10.0e6));
+        }
+
         // CRITICAL: Export counter output to PXI trigger line for chassis-wide sharing
         GetTerminalNameWithDevPrefix (taskHandle_, "PXI_Trig1", trig_name_do);
         NIDAQ::DAQmxExportSignal (counterTask, DAQmx_Val_CounterOutputEvent, trig_name_do);
 
         GetTerminalNameWithDevPrefix (taskHandle_, "PFI1", trig_demo);
-        NIDAQ::DAQmxConnectTerms (trig_name_do, trig_demo, DAQmx_Val_DoNotInvertPolarity);
+        connectRoute (trig_name_do, trig_demo);
 
 
         std::cout << "Counter clock (2*Fs) exported to: " << trig_name_do << std::endl;
@@ -223,25 +503,55 @@ public:
         NIDAQ::DAQmxExportSignal (taskHandle_, DAQmx_Val_StartTrigger, trig_name_start);
 
         GetTerminalNameWithDevPrefix (taskHandle_, "PFI2", trig_demo);
-        NIDAQ::DAQmxConnectTerms (trig_name_do, trig_demo, DAQmx_Val_DoNotInvertPolarity);
+        connectRoute (trig_name_do, trig_demo);
 
          NIDAQ::DAQmxCfgDigEdgeStartTrig (
              counterTask,
              trig_name_start,
              DAQmx_Val_Rising); // Set Start Clock;
+
+        if (chassis.mode == "master")
+        {
+            GetTerminalNameWithDevPrefix (taskHandle_, "PXI_Clk10", refClock);
+            GetTerminalNameWithDevPrefix (taskHandle_, STR2CHR (chassis.ref_clock_terminal), chassisTerm);
+            DAQmxCheck (connectRoute (refClock, chassisTerm));
+
+            GetTerminalNameWithDevPrefix (taskHandle_, STR2CHR (chassis.start_terminal), chassisTerm);
+            DAQmxCheck (connectRoute (trig_name_start, chassisTerm));
+            LOGC ("Reference clock and start trigger of ", name_, " exported to the other chassis");
+        }
+        else if (chassis.mode == "slave")
+        {
+            // The local start trigger, still exported on PXI_Trig2, follows the master chassis
+            GetTerminalNameWithDevPrefix (taskHandle_, STR2CHR (chassis.start_terminal), chassisTerm);
+            DAQmxCheck (NIDAQ::DAQmxCfgDigEdgeStartTrig (taskHandle_, chassisTerm, DAQmx_Val_Rising));
+            LOGC ("Waiting for the master chassis start trigger on ", chassisTerm);
+        }
     }
 
-    void setClock (char* trigName, char* trigStart, int bufferSize)
+    /** Slaves the task to the master: its sample clock (trigName), or, for a module running at a
+        multiple of the master rate, its own timebase locked to the chassis 10 MHz reference.
+        Both start on the master start trigger. */
+    void setClock (char* trigName, char* trigStart, int bufferSize, bool ownTimebase = false)
     {
+        resetClock();
 
         NIDAQ::DAQmxCfgSampClkTiming (
             taskHandle_,
-            trigName,
+            ownTimebase ? "" : trigName,
             getSampleRate(),
             DAQmx_Val_Rising,
             DAQmx_Val_ContSamps,
             bufferSize);
 
+        if (ownTimebase)
+        {
+            char refClock[256] = { "\0" };
+            GetTerminalNameWithDevPrefix (taskHandle_, "PXI_Clk10", refClock);
+            DAQmxCheck (NIDAQ::DAQmxSetRefClkSrc (taskHandle_, refClock));
+            DAQmxCheck (NIDAQ::DAQmxSetRefClkRate (taskHandle_, 10.0e6));
+        }
+
 
         GetTerminalNameWithDevPrefix (taskHandle_, "PXI_Trig2", trigStart);
 
@@ -252,16 +562,15 @@ public:
             DAQmx_Val_Rising); // Set Start Clock;
     }
 
-    void acquire (std::vector<NIDAQ::float64>* ai_data, int buffer_size)
+    /** Reads buffer_size samples per line into ai_data (grouped by channel) */
+    void acquire (NIDAQ::float64* ai_data, int buffer_size)
     {
-        ai_data->resize (analogLines_.size() * buffer_size);
-
         NIDAQ::DAQmxReadAnalogF64 (
             taskHandle_,
             buffer_size,
             timeout_,
             DAQmx_Val_GroupByChannel,
-            ai_data->data(),
+            ai_data,
             analogLines_.size() * buffer_size,
             nullptr,
             nullptr);
@@ -270,7 +579,39 @@ public:
 
 
 private:
+    /** Connects source to destination and remembers the route, so it is released on teardown */
+    NIDAQ::int32 connectRoute (const char* source, const char* destination)
+    {
+        const NIDAQ::int32 error = NIDAQ::DAQmxConnectTerms (source, destination, DAQmx_Val_DoNotInvertPolarity);
+        if (error >= 0)
+            routes_.emplace_back (source, destination);
+        return error;
+    }
+
+    void disconnectRoutes()
+    {
+        for (const auto& route : routes_)
+            NIDAQ::DAQmxDisconnectTerms (route.first.c_str(), route.second.c_str());
+        routes_.clear();
+    }
+
+    /** Undoes the timing state of a previous configuration on a reused task: terminal routes,
+        reference clock (slave chassis or own timebase) and start trigger */
+    void resetClock()
+    {
+        disconnectRoutes();
+
+        if (taskHandle_ == 0)
+            return;
+
+        NIDAQ::DAQmxResetRefClkSrc (taskHandle_);
+        NIDAQ::DAQmxResetRefClkRate (taskHandle_);
+        NIDAQ::DAQmxDisableStartTrig (taskHandle_);
+    }
+
     NIDAQ::float64 timeout_ = 5.0;
+    int currentRangeIndex_ = -1;
+    std::vector<std::pair<std::string, std::string>> routes_;
 
 };
 
@@ -285,15 +626,118 @@ public:
           digitalPort_ (digitalPort),
           numLines_ (numLines) {}
 
-    void setup (char* trigName, char* trigStart, int buffer, int numStation)
+    /** Writes the row scan waveform. The sequence lists the probe rows (station * numLines + line) in scan
+        order; this station drives the lines of its own rows and stays low for the others. Each step is held
+        for its dwell in AI samples, i.e. 2 * dwell ticks of the 2*Fs clock.
+        With useOnboardMemory the frame is loaded into the device FIFO and regenerated from there, which
+        keeps the DO transfers off the bus. If the device refuses it the task is rebuilt on the host buffer. */
+    void setup (char* trigName, char* trigStart, int buffer, const ScanSequence& sequence, bool useOnboardMemory = false)
+    {
+        LOGD ("Row scan ", name_, ": ", int (sequence.size()), " step(s)");
+
+        std::vector<NIDAQ::uInt32> waveform = makeFrameWaveform (sequence);
+        memoryStatus_ = "host";
+
+        if (useOnboardMemory)
+        {
+            try
+            {
+                createTask (trigName, trigStart, buffer, DAQmx_Val_AllowRegen);
+
+                NIDAQ::uInt32 onboardSize = 0;
+                DAQmxCheck (NIDAQ::DAQmxSetDOUseOnlyOnBrdMem (taskHandle_, "", 1));
+                DAQmxCheck (NIDAQ::DAQmxGetBufOutputOnbrdBufSize (taskHandle_, &onboardSize));
+
+                if (waveform.size() > onboardSize)
+                    throw std::runtime_error ("frame of " + std::to_string (waveform.size()) + " samples exceeds the "
+                                              + std::to_string (onboardSize) + " sample onboard buffer");
+
+                writeWaveform (waveform);
+                DAQmxCheck (NIDAQ::DAQmxTaskControl (taskHandle_, DAQmx_Val_Task_Commit));
+
+                memoryStatus_ = "onboard";
+                return;
+            }
+            catch (const std::exception& e)
+            {
+                memoryStatus_ = "host (onboard refused: " + String (e.what()) + ")";
+
+                if (taskHandle_ != 0)
+                {
+                    NIDAQ::DAQmxClearTask (taskHandle_);
+                    taskHandle_ = 0;
+                }
+            }
+        }
+
+        createTask (trigName, trigStart, buffer, DAQmx_Val_AllowRegen);
+        writeWaveform (waveform);
+    }
+
+    /** Streams the row scan instead of regenerating it, so that the scanned rows can change at a block
+        boundary. rowSets are the alternative scans (all with the same frame length); a chunk of
+        chunkFrames frames of each is precomputed here. Nothing is written: the processor queues the
+        first chunks before the start and keeps the stream a few chunks ahead of the generation.
+
+        The stream does not regenerate: if the chunks are not written in time the generation stops
+        and the next writeFrames() throws, which ends the acquisition. */
+    void setupStreaming (char* trigName,
+                         char* trigStart,
+                         const std::vector<ScanSequence>& rowSets,
+                         int chunkFrames,
+                         int blockFrames)
+    {
+        chunkWaveforms.clear();
+
+        for (const auto& sequence : rowSets)
+        {
+            std::vector<NIDAQ::uInt32> frame = makeFrameWaveform (sequence);
+            std::vector<NIDAQ::uInt32> chunk;
+            chunk.reserve (frame.size() * chunkFrames);
+
+            for (int f = 0; f < chunkFrames; f++)
+                chunk.insert (chunk.end(), frame.begin(), frame.end());
+
+            frameSamples_ = int (frame.size());
+            chunkWaveforms.push_back (std::move (chunk));
+        }
+
+        createTask (trigName, trigStart, frameSamples_ * jmax (blockFrames, chunkFrames), DAQmx_Val_DoNotAllowRegen);
+        memoryStatus_ = "host (streamed row sets)";
+        framesWritten_ = 0;
+    }
+
+    /** Queues numFrames frames (at most one chunk) of the given row set behind the frames already written */
+    void writeFrames (int set, int numFrames)
     {
-        const int pulseLengthInSamples = 2;
-        const int samplesPerStation = numLines_ * pulseLengthInSamples;
+        const NIDAQ::int32 error = writeSamples (chunkWaveforms[set].data(), numFrames * frameSamples_);
 
-        std::cout << "numStation : " << numStation << std::endl;
+        if (error == DAQmxErrorGenStoppedToPreventRegenOfOldSamples || error == DAQmxErrorOutputFIFOUnderflow2)
+            throw std::runtime_error ("row scan underflow on " + name_.toStdString()
+                                      + ": the DO stream ran out of queued frames and stopped");
+        DAQmxCheck (error);
 
+        framesWritten_ += numFrames;
+    }
+
+    /** Frames written but not generated yet, in streaming mode */
+    int64 getQueuedFrames()
+    {
+        // Not readable before the task is committed, when nothing has been generated yet
+        NIDAQ::uInt64 generated = 0;
+        if (DAQmxFailed (NIDAQ::DAQmxGetWriteTotalSampPerChanGenerated (taskHandle_, &generated)))
+            generated = 0;
+        return framesWritten_ - int64 (generated) / jmax (1, frameSamples_);
+    }
 
+    String getPort() const { return digitalPort_; }
+    /** Where the row scan is regenerated from after setup, with the reason of a fallback to the host */
+    String getMemoryStatus() const { return memoryStatus_; }
+    int numLines_ = 0;
 
+private:
+    void createTask (char* trigName, char* trigStart, int buffer, NIDAQ::int32 regenMode)
+    {
         DAQmxCheck (NIDAQ::DAQmxCreateTask (STR2CHR ("DITask_" + name_), &taskHandle_));
         DAQmxCheck (NIDAQ::DAQmxCreateDOChan (taskHandle_,
                                               STR2CHR (name_ + "/port0"),
@@ -316,40 +760,58 @@ public:
             trigStart,
             DAQmx_Val_Rising); // Set Start Clock;
 
-        DAQmxCheck (NIDAQ::DAQmxSetWriteRegenMode (taskHandle_, DAQmx_Val_AllowRegen));
+        DAQmxCheck (NIDAQ::DAQmxSetWriteRegenMode (taskHandle_, regenMode));
+    }
+
+    void writeWaveform (const std::vector<NIDAQ::uInt32>& waveform)
+    {
+        DAQmxCheck (writeSamples (waveform.data(), int (waveform.size())));
+    }
 
-        std::vector<NIDAQ::uInt32> waveform (samplesPerStation * numStation, 0);
-        int startSample = dev_index_ * samplesPerStation;
+    NIDAQ::int32 writeSamples (const NIDAQ::uInt32* samples, int numSamples)
+    {
+        return NIDAQ::DAQmxWriteDigitalU32 (
+            taskHandle_,
+            numSamples,
+            0,
+            timeout_,
+            DAQmx_Val_GroupByChannel,
+            samples,
+            NULL,
+            NULL);
+    }
 
-        NIDAQ::uInt32 bitMask = 0;
+    /** One frame of the row scan as seen by this station */
+    std::vector<NIDAQ::uInt32> makeFrameWaveform (const ScanSequence& sequence) const
+    {
+        std::vector<NIDAQ::uInt32> waveform (2 * getSequenceLength (sequence), 0);
+        int sampleOffset = 0;
 
-        for (int line_i = 0; line_i < numLines_; line_i++)
+        for (const auto& step : sequence)
         {
-            int sampleOffset = startSample + line_i * pulseLengthInSamples;
-            for (int s = 0; s < pulseLengthInSamples; s++)
+            const int pulseLengthInSamples = 2 * step.dwell;
+
+            if (step.row / numLines_ == dev_index_)
             {
-                bitMask = static_cast<NIDAQ::uInt32> (1 << line_i);
-                waveform[sampleOffset + s] = bitMask;
+                const int line_i = step.row % numLines_;
+                const NIDAQ::uInt32 bitMask = static_cast<NIDAQ::uInt32> (1 << line_i);
+
+                for (int s = 0; s < pulseLengthInSamples; s++)
+                    waveform[sampleOffset + s] = bitMask;
             }
-                
+
+            sampleOffset += pulseLengthInSamples;
         }
 
-        NIDAQ::int32 samplesWritten_dig = 0;
-        DAQmxCheck (NIDAQ::DAQmxWriteDigitalU32 (
-            taskHandle_,
-            samplesPerStation * numStation,
-            0,
-            timeout_,
-            DAQmx_Val_GroupByChannel,
-            waveform.data(),
-            NULL,
-            NULL));
+        return waveform;
     }
-    int numLines_ = 0;
 
-private:
     String digitalPort_;
     NIDAQ::float64 timeout_ = 10.0;
+    std::vector<std::vector<NIDAQ::uInt32>> chunkWaveforms; // one chunk per row set, streaming mode only
+    int frameSamples_ = 0;
+    int64 framesWritten_ = 0;
+    String memoryStatus_ = "host";
 };
 
 /* ================================================================
@@ -363,7 +825,7 @@ public:
 
     void setup (char* trigName, char* trigStart, int buffer)
     {
-        DAQmxCheck (NIDAQ::DAQmxCreateTask ("Event_DI_Task", &taskHandle_));
+        DAQmxCheck (NIDAQ::DAQmxCreateTask (STR2CHR ("EventDITask_" + name_ + "_" + digitalLine_.replaceCharacter ('/', '_')), &taskHandle_));
 
         DAQmxCheck (NIDAQ::DAQmxCreateDIChan (taskHandle_,
                                               STR2CHR (name_ + "/" + digitalLine_),
@@ -385,20 +847,19 @@ public:
 
     }
 
-    void acquire (std::vector<NIDAQ::uInt32>* di_data, int buffer_size)
+    void acquire (NIDAQ::uInt32* di_data, int buffer_size)
     {
-        di_data->resize (buffer_size);
-
         DAQmxCheck (NIDAQ::DAQmxReadDigitalU32 (
             taskHandle_,
             buffer_size,
             timeout_,
             DAQmx_Val_GroupByScanNumber,
-            di_data->data(),
+            di_data,
             buffer_size,
             nullptr,
             nullptr));
     }
+    String getDigitalLine() const { return digitalLine_; }
     int event_label_ = 0;
 
 private:
@@ -412,10 +873,83 @@ private:
 class StartChannel : public Channel
 {
 public:
-    StartChannel (String name, String digitalLine, float start_time, int nbr_pulse, float pulse_duration)
-        : Channel (name, 0), digitalLine_ (digitalLine), start_time_ (start_time), nbr_pulse_ (nbr_pulse), pulse_duration_ (pulse_duration) {}
+    StartChannel (String name,
+                  String digitalLine,
+                  float start_time,
+                  int nbr_pulse,
+                  float pulse_duration,
+                  String counter = "",
+                  String pulseTerminal = "")
+        : Channel (name, 0),
+          digitalLine_ (digitalLine),
+          start_time_ (start_time),
+          nbr_pulse_ (nbr_pulse),
+          pulse_duration_ (pulse_duration),
+          counter_ (counter),
+          pulseTerminal_ (pulseTerminal) {}
+
+    bool matches (const StartEventOutputConfig& cfg) const
+    {
+        return name_ == cfg.name && digitalLine_ == cfg.digital_line && start_time_ == cfg.start_time
+               && nbr_pulse_ == cfg.nbr_pulse && pulse_duration_ == cfg.pulse_duration && counter_ == cfg.counter
+               && pulseTerminal_ == cfg.pulse_terminal;
+    }
 
+    /** Arms the start pulse train on PXI_Trig2: start_time of silence, then nbr_pulse pulses of
+        pulse_duration separated by pulse_duration, all counted on the Fs clock. A configured counter
+        generates it with no buffer; the DO waveform is the fallback. */
     void setup (char* trigName, char* trigStart)
+    {
+        if (counter_.isNotEmpty())
+        {
+            try
+            {
+                setupCounter (trigName, trigStart);
+                return;
+            }
+            catch (const std::exception& e)
+            {
+                LOGE ("Start pulses on ", name_, "/", counter_, " unavailable, writing the DO waveform: ", e.what());
+                stop();
+            }
+        }
+
+        setupWaveform (trigName, trigStart);
+    }
+
+private:
+    void setupCounter (char* trigName, char* trigStart)
+    {
+        const int pulseTicks = int (pulse_duration_ * getSampleRate());
+        const int delayTicks = int (start_time_ * getSampleRate()) + pulseTicks;
+
+        // The counter needs at least 2 ticks per phase and one pulse
+        if (pulseTicks < 2 || nbr_pulse_ < 1)
+            throw std::runtime_error ("pulse of " + std::to_string (pulseTicks) + " ticks, "
+                                      + std::to_string (nbr_pulse_) + " pulses");
+
+        DAQmxCheck (NIDAQ::DAQmxCreateTask (STR2CHR ("StartPulseTask_" + name_), &taskHandle_));
+        DAQmxCheck (NIDAQ::DAQmxCreateCOPulseChanTicks (taskHandle_,
+                                                        STR2CHR (name_ + "/" + counter_),
+                                                        "",
+                                                        trigName,
+                                                        DAQmx_Val_Low,
+                                                        delayTicks,
+                                                        pulseTicks,
+                                                        pulseTicks));
+
+        if (pulseTerminal_.isNotEmpty())
+            DAQmxCheck (NIDAQ::DAQmxSetCOPulseTerm (taskHandle_, "", STR2CHR ("/" + name_ + "/" + pulseTerminal_)));
+
+        DAQmxCheck (NIDAQ::DAQmxCfgImplicitTiming (taskHandle_, DAQmx_Val_FiniteSamps, nbr_pulse_));
+
+        GetTerminalNameWithDevPrefix (taskHandle_, "PXI_Trig2", trigStart);
+        DAQmxCheck (NIDAQ::DAQmxCfgDigEdgeStartTrig (taskHandle_, trigStart, DAQmx_Val_Rising));
+
+        LOGD ("Start pulses: ", name_, "/", counter_, ", ", nbr_pulse_, " x ", pulseTicks, " ticks after ", delayTicks);
+    }
+
+    void setupWaveform (char* trigName, char* trigStart)
     {
         NIDAQ::float64 timeout = 5.0;
         float pulse_length = pulse_duration_ * getSampleRate();
@@ -424,7 +958,7 @@ public:
         std::vector<NIDAQ::uInt32> waveform_start (pulse_length * (nbr_pulse_ * 2 + 1) + pulse_start_length, 0);
         LOGD (waveform_start.size());
 
-        DAQmxCheck (NIDAQ::DAQmxCreateTask ("StartPulseTask", &taskHandle_));
+        DAQmxCheck (NIDAQ::DAQmxCreateTask (STR2CHR ("StartPulseTask_" + name_), &taskHandle_));
         DAQmxCheck (NIDAQ::DAQmxCreateDOChan (taskHandle_,
                                               STR2CHR (name_ + "/" + digitalLine_),
                                               "",
@@ -475,45 +1009,103 @@ public:
         }
     }
 
-private:
     String digitalLine_;
     float start_time_ = 0.0;
     int nbr_pulse_ = 0;
     float pulse_duration_ = 0.0;
+    String counter_;
+    String pulseTerminal_;
 };
 
 class NeuroProcessor : public Thread
 {
 public:
-    NeuroProcessor (NeuroConfig& cfg);
+    /** systemIndex 0 is cfg.neuroLayerSystem, which drives the chassis clocks, the start pulses and
+        the event inputs. Higher indices are cfg.additionalSystems, clocked by system 0 at chassisRate. */
+    NeuroProcessor (const NeuroConfig& cfg, int systemIndex = 0, NIDAQ::float64 chassisRate = 0);
     ~NeuroProcessor() {};
 
-    /* Pointer to the active device */
-    Array<InputAIChannel*> AIdevices;
-    Array<InputDIChannel*> DIdevices;
-    Array<EventDIChannel*> eventDevices;
-    StartChannel* startDevice = 0;
+    /** Applies a new configuration, rebuilding only the devices whose entry changed */
+    void updateConfig (const NeuroConfig& cfg, NIDAQ::float64 chassisRate = 0);
+
+    /** True for an additional probe system, which follows the clocks of system 0 */
+    bool isFollower() const { return systemIndex > 0; }
+    String getSystemName() const { return systemName; }
+    /** Starts a follower's tasks ahead of run(), so they are armed before system 0 starts the clock */
+    bool arm();
+    /** True from startAcquisition() until stopAcquisition(), whichever thread drives the reads */
+    bool isAcquiring() const { return acquiring; }
+
+    /* Active devices */
+    OwnedArray<InputAIChannel> AIdevices;
+    OwnedArray<InputDIChannel> DIdevices;
+    OwnedArray<EventDIChannel> eventDevices;
+    std::unique_ptr<StartChannel> startDevice;
 
     /* Analog configuration */
     NIDAQ::float64 getSampleRate() { return sampleRate; };
 
     float getVoltageRange() { return AIdevices[0]->voltageRanges[voltageRangeIndex]; };
+    int getVoltageRangeIndex() { return voltageRangeIndex; };
     Array<float> getAllVoltageRange() { return AIdevices[0]->voltageRanges; };
-    void setVoltageRange (int index) { voltageRangeIndex = index; };
+    /** Selects a new range. Between acquisitions the existing AI tasks are reconfigured
+        in place, otherwise the range is applied when the tasks are next set up. */
+    void setVoltageRange (int index);
 
     int getNsample() { return 3200; };
     int getRowNumber() { return numProbeRow; };
     int getColumnNumber() { return numProbeColumn; };
     int getCellNumber() { return getRowNumber() * getColumnNumber(); };
+    /** Probe column and row of an output channel, in the configured channel order */
+    int getChannelColumn (int channel) { return demuxPlan.outputColumn[channel]; };
+    int getChannelRow (int channel) { return demuxPlan.outputRow[channel]; };
+    /** AI samples per line in one frame, at the frame clock (the dwells of the scan sequence) */
+    int getSamplesPerFrame() { return demuxPlan.samplesPerFrame; };
+    /** AI samples averaged per row dwell */
+    int getOversampling() { return oversampling; };
+    /** Output frame rate: the AI rate divided by the samples in one frame */
+    double getFrameRate() { return getSamplesPerFrame() > 0 ? sampleRate / getSamplesPerFrame() : 0; };
+    /** ADC samples per cell per second on an AI module, before the dwell averaging (mean over the cells of a sequence) */
+    double getCellRate (int module)
+    {
+        if (getRowNumber() == 0 || ! isPositiveAndBelow (module, int (demuxPlan.rateFactor.size())))
+            return 0;
+        return sampleRate * demuxPlan.rateFactor[module] / getRowNumber();
+    };
 
-    void closeTask()
+    /** DataStreams published by this system: one with every channel, or one per group of column modules.
+        All of them carry the same sample numbers, timestamps and TTL words. */
+    int getStreamCount() const { return int (subStreams.size()); }
+    String getStreamName (int stream) const { return subStreams[stream].name; }
+    int getStreamChannelCount (int stream) const { return int (subStreams[stream].channels.size()); }
+    /** Probe cell ("C<column>,R<row>") or, on the row noise stream, probe row ("R<row>") of a stream channel */
+    String getStreamChannelName (int stream, int index)
+    {
+        const int ch = subStreams[stream].channels[index];
+        if (subStreams[stream].rowNoise)
+            return "R" + String (demuxPlan.scannedRows[ch]);
+        return "C" + String (getChannelColumn (ch)) + ",R" + String (getChannelRow (ch));
+    }
+
+    /** Frames the DataBuffer must hold: one block plus the configured headroom (at least one more block) */
+    int getBufferFrames();
+    /** Frames dropped by the overrun policy since the start of the acquisition */
+    int64 getDroppedFrames() const { return droppedFrames.load(); }
+
+    /** Stops all tasks. The AI tasks can be kept alive so that the next acquisition
+        (or a range change) does not need to recreate them. */
+    void closeTask (bool keepAnalogTasks = false)
     {
         /*********************************************/
         // DAQmx Stop Code
         /*********************************************/
+        // Both also disconnect the terminal routes, including the master chassis exports
         for (int dev_i = 0; dev_i < AIdevices.size(); dev_i++)
         {
-            AIdevices[dev_i]->stop();
+            if (keepAnalogTasks)
+                AIdevices[dev_i]->pause();
+            else
+                AIdevices[dev_i]->stop();
         }
 
         for (int dev_i = 0; dev_i < DIdevices.size(); dev_i++)
@@ -526,23 +1118,212 @@ public:
             eventDevices[dev_i]->stop();
         }
 
-        if (startDevice != 0 && startDevice != nullptr)
+        if (startDevice != nullptr)
             startDevice->stop();
     };
 
+    /** Dedicated-thread mode: sets up the tasks, then reads, demuxes and publishes until asked to exit */
     void run();
 
+    /** Sets up and starts the tasks and allocates the block buffers. Returns false on failure. */
+    bool startAcquisition();
+    /** Non-blocking step used when the DataThread drives the acquisition: processes one block
+        if it is fully available, otherwise sleeps briefly. Returns false on a driver error. */
+    bool pollBlock();
+    /** Stops the tasks and releases the block buffers */
+    void stopAcquisition();
+    /** Writes the calibration captured or measured during the last acquisition, if any. Called on the
+        message thread once the acquisition has stopped, never on the acquisition thread. */
+    void writeCalibration();
+    /** Interrupts a publishBlock() waiting for room in the DataBuffer */
+    void requestStop() { stopRequested = true; }
+
+    /** Number of row sets the scan can switch between (1 when switching is not configured) */
+    int getRoiSetCount() const { return int (roiSets.size()); }
+    /** Asks for the given row set. Takes effect on the block after the next one,
+        marked by a TTL event on its first frame. */
+    void requestRoi (int set);
+
+    /** Settling of each module, measured at the start of the last acquisition or loaded from the
+        calibration file (empty if neither) */
+    std::vector<SettlingCalibration> getSettlingCalibration()
+    {
+        const ScopedLock lock (statusLock);
+        return settlingCalibration;
+    }
+
+    /** Result of the last attempt to apply the realtime settings */
+    RealtimeStatus getRealtimeStatus()
+    {
+        const ScopedLock lock (statusLock);
+        return realtimeStatus;
+    }
+
     NIDAQ::float64 sampleRate;
-    DataBuffer* aiBuffer = nullptr;
+    std::vector<DataBuffer*> aiBuffers; // one per stream, all aiBufferFrames deep
+    int aiBufferFrames = 0;
 
 private:
-    HeapBlock<NIDAQ::uInt32> eventCodes;
+    /** Fills the device capabilities from the cache, querying the driver only for unseen modules */
+    void configureDevice (Channel* device);
+
+    /** Applies priority and CPU affinity to the calling (acquisition) thread */
+    void applyRealtimeSettings();
+
+    /** True when every AI and event task holds a full block */
+    bool isBlockAvailable();
+    /** Reads one block from every task (blocking), demuxes it and publishes it */
+    void processBlock();
+    /** Measures the settling on the raw block just read and, in "auto" mode, updates the discard */
+    void calibrateSettling();
+    /** Key of the stored settling calibration of a module: its geometry, dwell and tolerance */
+    SettlingRecord getSettlingKey (int module);
+    /** Accumulates the baseline of each cell on a chunk of frames and, once calibration_capture_ms
+        is reached, folds it into the offsets */
+    void captureCalibration (const float* chunk, int numFrames);
+    /** Loads the probe-wide calibration into the active and the ROI demux plans */
+    void applyCellCalibration();
+    /** Compares the shared sync pulses of the block with their nominal timing, in frames */
+    void checkChassisSync();
+
+    /** Valid, sorted probe rows of an ROI */
+    std::vector<int> validateRows (const Array<int>& rows, int totalRows);
+    bool isRoiSwitchable() const { return roiSets.size() > 1; }
+    /** Makes a row set's demux plan the active one */
+    void switchRoi (int set);
+    /** Writes DO scan chunks until the stream is rowScanLeadChunks ahead of the generation. The row set
+        is chosen when the first chunk of a block is written: the requested one, unless a switch is
+        already queued and not processed yet. */
+    void topUpRowScan();
+
+    bool shouldStop() { return stopRequested || threadShouldExit(); }
+
+    /** Builds the spatial stages of each row set from the config and the bad cells */
+    void buildSpatialPlans (const NeuroLayerSystemConfig& system);
+
+    /** Splits the output channels into streams by column module */
+    void buildSubStreams (const NeuroLayerSystemConfig& system);
+
+    /** Pushes a demuxed block to the DataBuffers, applying the overrun policy when one is full */
+    void publishBlock (float* output, int64* sampleNumbers, double* timestamps, uint64* eventCodes, int numFrames);
+
+    enum class OverrunPolicy
+    {
+        Block,
+        DropOldest,
+        DropNewest
+    };
+
+    DataBufferConfig bufferConfig;
+    OverrunPolicy overrunPolicy = OverrunPolicy::Block;
+    std::atomic<int64> droppedFrames { 0 };
+    bool overrunPending = false;
+
+    std::map<String, DeviceCapabilities> capabilityCache;
+
+    RealtimeConfig realtimeConfig;
+    RealtimeStatus realtimeStatus;
+
+    /** Output channels published together as one DataStream */
+    struct SubStream
+    {
+        String name;
+        std::vector<int> channels; // output channels, ascending (cell rows on the row noise stream)
+        std::vector<std::pair<int, int>> runs; // (first channel, count) of consecutive channels
+        float* output = nullptr; // gathered block, null when the stream holds the whole output
+        bool rowNoise = false; // publishes the row component removed by the row noise stage
+    };
+
+    std::vector<SubStream> subStreams;
+
+    /* Per-block acquisition buffers, carved from the arena */
+    BlockArena arena;
+    float* blockOutput = nullptr;
+    int64* blockSampleNumbers = nullptr;
+    double* blockTimestamps = nullptr;
+    uint64* blockEventCodes = nullptr;
+    std::vector<NIDAQ::float64*> dev_ai_data;
+    std::vector<NIDAQ::uInt32*> dev_di_event;
+
+    /* Demux plan and kernels, selected once per config */
+    DemuxPlan demuxPlan;
+    DemuxKernels demuxKernels;
+    std::vector<uint64> eventMasks;
+
+    SettlingConfig settlingConfig;
+    std::vector<SettlingCalibration> settlingCalibration;
+    bool settlingPending = false;
+    std::vector<SettlingRecord> settlingRecords; // stored in settlingFile, for every geometry met so far
+    File settlingFile;
+    bool settlingStored = false; // settlingCalibration comes from the file, no measurement needed
+    bool settlingMeasured = false; // the records are written when the acquisition stops
+
+    /* Per-cell calibration, indexed column * probeRows + probe row */
+    std::vector<float> cellOffset;
+    std::vector<float> cellGain;
+    int probeRows = 0;
+    File calibrationFile;
+    std::vector<CellCalibration> calibrationCells; // cell table of the file, rewritten in "capture" mode only
+    bool calibrationCapture = false;
+    int calibrationCaptureMs = 0;
+    int64 captureRemaining = 0; // frames still to average
+    std::vector<double> captureChannelSum; // per output channel, for the current block
+    std::vector<double> captureSum; // per probe cell
+    std::vector<int64> captureCount;
+    bool calibrationCaptured = false; // the table is written when the acquisition stops
+
+    /* Spatial stages, one plan per row set */
+    std::vector<bool> badCell; // indexed like cellOffset
+    std::vector<ReferencePlan> referencePlans;
+    std::vector<ReferencePlan> rowNoisePlans; // reference per row of each row set
+    std::vector<LaplacianPlan> laplacianPlans;
+    float* rowNoiseOutput = nullptr; // removed row signal of the block, when it is published
+    int spatialScratchSize = 0; // floats
+    float* spatialScratch = nullptr;
+    int spatialChunkFrames = 1;
+
+    std::atomic<bool> stopRequested { false };
+    bool realtimeApplied = false;
+    CriticalSection statusLock;
+
     int voltageRangeIndex { 0 };
     int64 ai_timestamp = 0;
     uint64 eventCode = 0;
 
     int numProbeColumn = 0;
-    int numProbeRow = 0;
+    int numProbeRow = 0; // scanned rows
+    ScanSequence scanSequence; // startup row scan (every row unless an ROI or a sequence is set)
+
+    /* Runtime row set switching: the DO scan is streamed in chunks of a block, a couple of chunks ahead,
+       so a set requested before the last lead of a block is scanned from the next block on */
+    static constexpr int rowScanChunks = 8; // chunks per block
+    static constexpr int rowScanLeadChunks = 2; // chunks queued ahead of the generation
+    std::vector<ScanSequence> roiSets; // set 0 is scanSequence
+    std::vector<DemuxPlan> roiPlans;
+    int rowScanChunkFrames = 1;
+    int64 rowScanFramesWritten = 0;
+    int rowScanSet = 0; // set being written to the DO tasks
+    int64 rowScanSwitchBlock = -1; // block from which rowScanSet is scanned, until processed (-1: none pending)
+    int64 processedBlocks = 0;
+    std::atomic<int> requestedRoi { 0 };
+    int activeRoi = 0;
+    uint64 roiEventMask = 0;
+    int oversampling = 1;
+    bool rowScanOnboard = false; // regenerate the row scan from the DO FIFOs when the modules allow it
+    PerformanceConfig performanceConfig;
+
+    int systemIndex = 0;
+    String systemName;
+    bool armed = false;
+    std::atomic<bool> acquiring { false };
+
+    /* Multi-chassis alignment, checked on the shared sync pulse */
+    ChassisConfig chassisConfig;
+    uint64 syncMask = 0;
+    bool syncLevel = false;
+    int64 syncFirstSample = -1;
+    int64 syncPulses = 0;
+    bool syncAligned = true;
 };
 
 #endif // __NIDAQCOMPONENTS_H__
\ No newline at end of file
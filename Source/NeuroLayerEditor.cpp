@@ -54,15 +54,65 @@ void NeuroLayerEditor::setupUI()
     configFileLabel = new Label();
     addAndMakeVisible(configFileLabel.get());
     configFileLabel->setBounds(15, 105, 200, 20);
+
+    settlingLabel = new Label();
+    addAndMakeVisible(settlingLabel.get());
+    settlingLabel->setFont(Font(12.0f));
+    settlingLabel->setBounds(10, 28, 185, 20);
+}
+
+void NeuroLayerEditor::startAcquisition()
+{
+    // Neither can be applied to running tasks
+    voltageRangeSelector->setEnabled(false);
+    configFileButton->setEnabled(false);
+
+    settlingLabel->setText("", dontSendNotification);
+    startTimer(500);
+}
+
+void NeuroLayerEditor::stopAcquisition()
+{
+    voltageRangeSelector->setEnabled(true);
+    configFileButton->setEnabled(true);
+
+    stopTimer();
+    timerCallback();
+}
+
+void NeuroLayerEditor::timerCallback()
+{
+    if (thread == nullptr)
+        return;
+
+    auto calibration = thread->getSettlingCalibration();
+    if (calibration.empty())
+        return;
+
+    // Discard per module on the label, residual energy in the tooltip
+    StringArray discards, details;
+    for (const auto& module : calibration)
+    {
+        discards.add(String(module.discardSamples));
+        details.add("discard " + String(module.discardSamples) + ", residual "
+                    + String(module.residualEnergy * 1.0e12, 1) + " uV^2");
+    }
+
+    settlingLabel->setText("Settling K: " + discards.joinIntoString(","), dontSendNotification);
+    settlingLabel->setTooltip(details.joinIntoString("\n"));
+    stopTimer();
 }
 
 void NeuroLayerEditor::comboBoxChanged(ComboBox* comboBoxThatChanged)
 {
     if (thread != nullptr && comboBoxThatChanged == voltageRangeSelector.get())
     {
+        // Combo box IDs start at 1
         int selectedId = voltageRangeSelector->getSelectedId();
-        thread->setVoltageRange(selectedId); 
-        CoreServices::updateSignalChain (this);
+        // The tasks are reconfigured in place; downstream processors and the Record Node hold their
+        // own copies of the channels, so the new bitVolts go through the signal chain
+        if (selectedId > 0 && thread->setVoltageRange(selectedId - 1))
+            CoreServices::updateSignalChain (this);
     }
 }
 
@@ -85,28 +135,81 @@ void NeuroLayerEditor::buttonClicked(Button* button)
                 voltageRangeSelector->clear(); 
 
                 for(int i=0; i<voltage_range.size(); i++){
-                    voltageRangeSelector->addItem ("-" + String(voltage_range[i]) + " to " +  String(voltage_range[i]) + " V", i);
+                    voltageRangeSelector->addItem ("-" + String(voltage_range[i]) + " to " +  String(voltage_range[i]) + " V", i + 1);
                 }
-                voltageRangeSelector->setSelectedId(1); 
+                voltageRangeSelector->setSelectedId(thread->getVoltageRangeIndex() + 1, dontSendNotification); 
                 CoreServices::updateSignalChain (this);
         }
 
     }
 }
-void NeuroLayerEditor::saveCustomParametersToXml (XmlElement* xml)
+/** Writes one probe system under sysXml */
+static void saveSystemToXml (const NeuroLayerSystemConfig& system, XmlElement* sysXml)
 {
-    if (xml == nullptr)
-        return;
+    sysXml->setAttribute ("name", system.name);
+    sysXml->setAttribute ("numRows", system.numRows);
+    sysXml->setAttribute ("oversampling", system.oversampling);
+    sysXml->setAttribute ("module_rates", system.module_rates);
+
+    StringArray roiRows;
+    for (int row : system.roi_rows)
+        roiRows.add (String (row));
+    sysXml->setAttribute ("roi_rows", roiRows.joinIntoString (","));
+    sysXml->setAttribute ("roi_event_label", system.roi_event_label);
+    sysXml->setAttribute ("row_scan_memory", system.row_scan_memory);
+    sysXml->setAttribute ("stream_split", system.stream_split);
+
+    // Stream groups (one child per group)
+    XmlElement* groupsXml = sysXml->createNewChildElement ("stream_groups");
+    for (const auto& group : system.stream_groups)
+        groupsXml->createNewChildElement ("group")->setAttribute ("modules", group.joinIntoString (","));
+
+    // Scan sequence (one child per step)
+    XmlElement* sequenceXml = sysXml->createNewChildElement ("scan_sequence");
+    for (const auto& step : system.scan_sequence)
+    {
+        XmlElement* stepXml = sequenceXml->createNewChildElement ("step");
+        stepXml->setAttribute ("row", step.first);
+        stepXml->setAttribute ("dwell", step.second);
+    }
 
-    // -----------------------------
-    // neuroLayerSystem
-    // -----------------------------
-    XmlElement* sysXml = xml->createNewChildElement ("neuroLayerSystem");
-    sysXml->setAttribute ("numRows", thread->neuroConfig.neuroLayerSystem.numRows);
+    // ROI sets (one child per set)
+    XmlElement* roiSetsXml = sysXml->createNewChildElement ("roi_sets");
+    for (const auto& set : system.roi_sets)
+    {
+        StringArray rows;
+        for (int row : set)
+            rows.add (String (row));
+        roiSetsXml->createNewChildElement ("set")->setAttribute ("rows", rows.joinIntoString (","));
+    }
+
+    sysXml->setAttribute ("channel_order", system.channel_order);
+    sysXml->setAttribute ("probe_map_file", system.probe_map_file);
+    sysXml->setAttribute ("calibration_file", system.calibration_file);
+    sysXml->setAttribute ("calibration_mode", system.calibration_mode);
+    sysXml->setAttribute ("calibration_capture_ms", system.calibration_capture_ms);
+    sysXml->setAttribute ("reference", system.reference);
+    sysXml->setAttribute ("row_noise", system.row_noise);
+    sysXml->setAttribute ("row_noise_stream", system.row_noise_stream);
+    sysXml->setAttribute ("spatial_filter", system.spatial_filter);
+
+    StringArray laplacianWeights;
+    for (float weight : system.laplacian_weights)
+        laplacianWeights.add (String (weight));
+    sysXml->setAttribute ("laplacian_weights", laplacianWeights.joinIntoString (","));
+
+    // Bad cells (one child per cell)
+    XmlElement* badCellsXml = sysXml->createNewChildElement ("bad_cells");
+    for (const auto& cell : system.bad_cells)
+    {
+        XmlElement* cellXml = badCellsXml->createNewChildElement ("cell");
+        cellXml->setAttribute ("column", cell.first);
+        cellXml->setAttribute ("row", cell.second);
+    }
 
     // Columns (array of pairs)
     XmlElement* colsXml = sysXml->createNewChildElement ("columns");
-    for (const auto& entry : thread->neuroConfig.neuroLayerSystem.columns)
+    for (const auto& entry : system.columns)
     {
         const auto& module = entry.first;
         for (const auto& line : entry.second)
@@ -119,12 +222,134 @@ void NeuroLayerEditor::saveCustomParametersToXml (XmlElement* xml)
 
     // Rows (array of pairs)
     XmlElement* rowsXml = sysXml->createNewChildElement ("rows");
-    for (const auto& entry : thread->neuroConfig.neuroLayerSystem.rows)
+    for (const auto& entry : system.rows)
     {
         XmlElement* rowItem = rowsXml->createNewChildElement ("item");
         rowItem->setAttribute ("module", entry.first);
         rowItem->setAttribute ("port", entry.second);
     }
+}
+
+/** Reads one probe system written by saveSystemToXml */
+static void loadSystemFromXml (NeuroLayerSystemConfig& system, const XmlElement* sysXml)
+{
+    system = NeuroLayerSystemConfig();
+    system.name = sysXml->getStringAttribute("name", "NeuroLayer");
+    system.numRows = sysXml->getIntAttribute("numRows", 0);
+    system.oversampling = sysXml->getIntAttribute("oversampling", 1);
+    system.module_rates = sysXml->getStringAttribute("module_rates", "shared");
+
+    for (auto& row : StringArray::fromTokens(sysXml->getStringAttribute("roi_rows", ""), ",", ""))
+        if (row.trim().isNotEmpty())
+            system.roi_rows.add(row.getIntValue());
+    system.roi_event_label = sysXml->getIntAttribute("roi_event_label", 62);
+    system.row_scan_memory = sysXml->getStringAttribute("row_scan_memory", "host");
+    system.stream_split = sysXml->getStringAttribute("stream_split", "none");
+
+    if (auto* groupsXml = sysXml->getChildByName("stream_groups"))
+    {
+        forEachXmlChildElementWithTagName(*groupsXml, groupXml, "group")
+        {
+            StringArray modules = StringArray::fromTokens(groupXml->getStringAttribute("modules", ""), ",", "");
+            modules.trim();
+            modules.removeEmptyStrings();
+            system.stream_groups.add(modules);
+        }
+    }
+
+    if (auto* sequenceXml = sysXml->getChildByName("scan_sequence"))
+    {
+        forEachXmlChildElementWithTagName(*sequenceXml, stepXml, "step")
+        {
+            system.scan_sequence.emplace_back(stepXml->getIntAttribute("row", 0), stepXml->getIntAttribute("dwell", 1));
+        }
+    }
+
+    if (auto* roiSetsXml = sysXml->getChildByName("roi_sets"))
+    {
+        forEachXmlChildElementWithTagName(*roiSetsXml, setXml, "set")
+        {
+            Array<int> rows;
+            for (auto& row : StringArray::fromTokens(setXml->getStringAttribute("rows", ""), ",", ""))
+                if (row.trim().isNotEmpty())
+                    rows.add(row.getIntValue());
+            system.roi_sets.add(rows);
+        }
+    }
+    system.channel_order = sysXml->getStringAttribute("channel_order", "column_major");
+    system.probe_map_file = sysXml->getStringAttribute("probe_map_file", "");
+
+    if (system.probe_map_file.isNotEmpty())
+        loadProbeMap(File(system.probe_map_file), system.probe_map);
+
+    system.calibration_file = sysXml->getStringAttribute("calibration_file", "");
+    system.calibration_mode = sysXml->getStringAttribute("calibration_mode", "apply");
+    system.calibration_capture_ms = sysXml->getIntAttribute("calibration_capture_ms", 1000);
+    system.reference = sysXml->getStringAttribute("reference", "none");
+    system.row_noise = sysXml->getStringAttribute("row_noise", "none");
+    system.row_noise_stream = sysXml->getBoolAttribute("row_noise_stream", false);
+    system.spatial_filter = sysXml->getStringAttribute("spatial_filter", "none");
+
+    StringArray laplacianWeights = StringArray::fromTokens(sysXml->getStringAttribute("laplacian_weights", ""), ",", "");
+    laplacianWeights.removeEmptyStrings();
+    if (laplacianWeights.size() == 3)
+    {
+        system.laplacian_weights.clear();
+        for (auto& weight : laplacianWeights)
+            system.laplacian_weights.push_back(weight.getFloatValue());
+    }
+
+    if (auto* badCellsXml = sysXml->getChildByName("bad_cells"))
+    {
+        forEachXmlChildElementWithTagName(*badCellsXml, cellXml, "cell")
+        {
+            system.bad_cells.emplace_back(cellXml->getIntAttribute("column", 0), cellXml->getIntAttribute("row", 0));
+        }
+    }
+
+    loadSystemCalibration(system);
+
+    // Columns
+    if (auto* colsXml = sysXml->getChildByName("columns"))
+    {
+        forEachXmlChildElementWithTagName(*colsXml, item, "item")
+        {
+            const auto module = item->getStringAttribute("module");
+            const auto line   = item->getStringAttribute("line");
+            if (module.isNotEmpty() && line.isNotEmpty())
+                system.columns[module].add(line);
+        }
+    }
+
+    // Rows
+    if (auto* rowsXml = sysXml->getChildByName("rows"))
+    {
+        forEachXmlChildElementWithTagName(*rowsXml, item, "item")
+        {
+            const auto module = item->getStringAttribute("module");
+            const auto port   = item->getStringAttribute("port");
+            if (module.isNotEmpty() && port.isNotEmpty())
+                system.rows[module] = port;
+        }
+    }
+}
+
+void NeuroLayerEditor::saveCustomParametersToXml (XmlElement* xml)
+{
+    if (xml == nullptr)
+        return;
+
+    // -----------------------------
+    // neuroLayerSystem
+    // -----------------------------
+    saveSystemToXml (thread->neuroConfig.neuroLayerSystem, xml->createNewChildElement ("neuroLayerSystem"));
+
+    // -----------------------------
+    // additional_systems
+    // -----------------------------
+    XmlElement* systemsXml = xml->createNewChildElement ("additional_systems");
+    for (const auto& system : thread->neuroConfig.additionalSystems)
+        saveSystemToXml (system, systemsXml->createNewChildElement ("system"));
 
     // -----------------------------
     // start_event_output
@@ -136,6 +361,8 @@ void NeuroLayerEditor::saveCustomParametersToXml (XmlElement* xml)
     startXml->setAttribute ("pulse_duration", start.pulse_duration);
     startXml->setAttribute ("module_name", start.name);
     startXml->setAttribute ("digital_line", start.digital_line);
+    startXml->setAttribute ("counter", start.counter);
+    startXml->setAttribute ("pulse_terminal", start.pulse_terminal);
 
     // -----------------------------
     // event_input
@@ -149,6 +376,66 @@ void NeuroLayerEditor::saveCustomParametersToXml (XmlElement* xml)
         evXml->setAttribute ("oe_event_label", ev.oe_event_label);
     }
 
+    // -----------------------------
+    // realtime
+    // -----------------------------
+    const auto& realtime = thread->neuroConfig.realtime;
+    XmlElement* rtXml = xml->createNewChildElement ("realtime");
+    rtXml->setAttribute ("thread_priority", realtime.thread_priority);
+    rtXml->setAttribute ("rt_priority", realtime.rt_priority);
+    rtXml->setAttribute ("lock_memory", realtime.lock_memory);
+    rtXml->setAttribute ("huge_pages", realtime.huge_pages);
+
+    StringArray cpus;
+    for (int cpu : realtime.cpu_affinity)
+        cpus.add (String (cpu));
+    rtXml->setAttribute ("cpu_affinity", cpus.joinIntoString (","));
+
+    // -----------------------------
+    // data_buffer
+    // -----------------------------
+    const auto& dataBuffer = thread->neuroConfig.dataBuffer;
+    XmlElement* bufferXml = xml->createNewChildElement ("data_buffer");
+    bufferXml->setAttribute ("headroom_ms", dataBuffer.headroom_ms);
+    bufferXml->setAttribute ("overrun_policy", dataBuffer.overrun_policy);
+    bufferXml->setAttribute ("overrun_event_label", dataBuffer.overrun_event_label);
+
+    // -----------------------------
+    // acquisition
+    // -----------------------------
+    XmlElement* acqXml = xml->createNewChildElement ("acquisition");
+    acqXml->setAttribute ("mode", thread->neuroConfig.acquisition.mode);
+
+    // -----------------------------
+    // settling
+    // -----------------------------
+    XmlElement* settlingXml = xml->createNewChildElement ("settling");
+    settlingXml->setAttribute ("mode", thread->neuroConfig.settling.mode);
+    settlingXml->setAttribute ("discard_samples", thread->neuroConfig.settling.discard_samples);
+    settlingXml->setAttribute ("tolerance_mv", thread->neuroConfig.settling.tolerance_mv);
+    settlingXml->setAttribute ("recalibrate", thread->neuroConfig.settling.recalibrate);
+
+    // -----------------------------
+    // performance
+    // -----------------------------
+    XmlElement* performanceXml = xml->createNewChildElement ("performance");
+    performanceXml->setAttribute ("input_buffer_ms", thread->neuroConfig.performance.input_buffer_ms);
+    performanceXml->setAttribute ("transfer_mechanism", thread->neuroConfig.performance.transfer_mechanism);
+    performanceXml->setAttribute ("request_condition", thread->neuroConfig.performance.request_condition);
+    performanceXml->setAttribute ("read_wait_mode", thread->neuroConfig.performance.read_wait_mode);
+
+    // -----------------------------
+    // chassis
+    // -----------------------------
+    const auto& chassis = thread->neuroConfig.chassis;
+    XmlElement* chassisXml = xml->createNewChildElement ("chassis");
+    chassisXml->setAttribute ("mode", chassis.mode);
+    chassisXml->setAttribute ("ref_clock_terminal", chassis.ref_clock_terminal);
+    chassisXml->setAttribute ("start_terminal", chassis.start_terminal);
+    chassisXml->setAttribute ("sync_event_label", chassis.sync_event_label);
+    chassisXml->setAttribute ("sync_period_s", chassis.sync_period_s);
+    chassisXml->setAttribute ("sync_tolerance_frames", chassis.sync_tolerance_frames);
+
     // -----------------------------
     // voltage_range
     // -----------------------------
@@ -179,34 +466,19 @@ void NeuroLayerEditor::loadCustomParametersFromXml (XmlElement* xml)
     // neuroLayerSystem
     // -----------------------------
     if (auto* sysXml = xml->getChildByName("neuroLayerSystem"))
-    {
-        thread->neuroConfig.neuroLayerSystem.columns.clear();
-        thread->neuroConfig.neuroLayerSystem.rows.clear();
-        thread->neuroConfig.neuroLayerSystem.numRows = 
-            sysXml->getIntAttribute("numRows", 0);
-
-        // Columns
-        if (auto* colsXml = sysXml->getChildByName("columns"))
-        {
-            forEachXmlChildElementWithTagName(*colsXml, item, "item")
-            {
-                const auto module = item->getStringAttribute("module");
-                const auto line   = item->getStringAttribute("line");
-                if (module.isNotEmpty() && line.isNotEmpty())
-                    thread->neuroConfig.neuroLayerSystem.columns[module].add(line);
-            }
-        }
+        loadSystemFromXml (thread->neuroConfig.neuroLayerSystem, sysXml);
 
-        // Rows
-        if (auto* rowsXml = sysXml->getChildByName("rows"))
+    // -----------------------------
+    // additional_systems
+    // -----------------------------
+    thread->neuroConfig.additionalSystems.clear();
+    if (auto* systemsXml = xml->getChildByName("additional_systems"))
+    {
+        forEachXmlChildElementWithTagName(*systemsXml, sysXml, "system")
         {
-            forEachXmlChildElementWithTagName(*rowsXml, item, "item")
-            {
-                const auto module = item->getStringAttribute("module");
-                const auto port   = item->getStringAttribute("port");
-                if (module.isNotEmpty() && port.isNotEmpty())
-                    thread->neuroConfig.neuroLayerSystem.rows[module] = port;
-            }
+            NeuroLayerSystemConfig system;
+            loadSystemFromXml (system, sysXml);
+            thread->neuroConfig.additionalSystems.add (system);
         }
     }
 
@@ -221,6 +493,8 @@ void NeuroLayerEditor::loadCustomParametersFromXml (XmlElement* xml)
         start.pulse_duration = (float) startXml->getDoubleAttribute("pulse_duration", 0.0);
         start.name         = startXml->getStringAttribute("module_name", "");
         start.digital_line = startXml->getStringAttribute("digital_line", "");
+        start.counter      = startXml->getStringAttribute("counter", "");
+        start.pulse_terminal = startXml->getStringAttribute("pulse_terminal", "");
     }
 
     // -----------------------------
@@ -242,6 +516,85 @@ void NeuroLayerEditor::loadCustomParametersFromXml (XmlElement* xml)
         }
     }
 
+    // -----------------------------
+    // realtime
+    // -----------------------------
+    thread->neuroConfig.realtime = RealtimeConfig();
+    if (auto* rtXml = xml->getChildByName("realtime"))
+    {
+        auto& realtime = thread->neuroConfig.realtime;
+        realtime.thread_priority = rtXml->getStringAttribute("thread_priority", "normal");
+        realtime.rt_priority     = rtXml->getIntAttribute("rt_priority", 80);
+        realtime.lock_memory     = rtXml->getBoolAttribute("lock_memory", false);
+        realtime.huge_pages      = rtXml->getBoolAttribute("huge_pages", true);
+
+        for (auto& cpu : StringArray::fromTokens(rtXml->getStringAttribute("cpu_affinity", ""), ",", ""))
+        {
+            if (cpu.isNotEmpty())
+                realtime.cpu_affinity.add(cpu.getIntValue());
+        }
+    }
+
+    // -----------------------------
+    // data_buffer
+    // -----------------------------
+    thread->neuroConfig.dataBuffer = DataBufferConfig();
+    if (auto* bufferXml = xml->getChildByName("data_buffer"))
+    {
+        auto& dataBuffer = thread->neuroConfig.dataBuffer;
+        dataBuffer.headroom_ms         = (float) bufferXml->getDoubleAttribute("headroom_ms", 1000.0);
+        dataBuffer.overrun_policy      = bufferXml->getStringAttribute("overrun_policy", "block");
+        dataBuffer.overrun_event_label = bufferXml->getIntAttribute("overrun_event_label", 63);
+    }
+
+    // -----------------------------
+    // acquisition
+    // -----------------------------
+    thread->neuroConfig.acquisition = AcquisitionConfig();
+    if (auto* acqXml = xml->getChildByName("acquisition"))
+        thread->neuroConfig.acquisition.mode = acqXml->getStringAttribute("mode", "thread");
+
+    // -----------------------------
+    // settling
+    // -----------------------------
+    thread->neuroConfig.settling = SettlingConfig();
+    if (auto* settlingXml = xml->getChildByName("settling"))
+    {
+        auto& settling = thread->neuroConfig.settling;
+        settling.mode            = settlingXml->getStringAttribute("mode", "off");
+        settling.discard_samples = settlingXml->getIntAttribute("discard_samples", 0);
+        settling.tolerance_mv    = (float) settlingXml->getDoubleAttribute("tolerance_mv", 0.5);
+        settling.recalibrate     = settlingXml->getBoolAttribute("recalibrate", false);
+    }
+
+    // -----------------------------
+    // performance
+    // -----------------------------
+    thread->neuroConfig.performance = PerformanceConfig();
+    if (auto* performanceXml = xml->getChildByName("performance"))
+    {
+        auto& performance = thread->neuroConfig.performance;
+        performance.input_buffer_ms    = (float) performanceXml->getDoubleAttribute("input_buffer_ms", 0.0);
+        performance.transfer_mechanism = performanceXml->getStringAttribute("transfer_mechanism", "default");
+        performance.request_condition  = performanceXml->getStringAttribute("request_condition", "default");
+        performance.read_wait_mode     = performanceXml->getStringAttribute("read_wait_mode", "default");
+    }
+
+    // -----------------------------
+    // chassis
+    // -----------------------------
+    thread->neuroConfig.chassis = ChassisConfig();
+    if (auto* chassisXml = xml->getChildByName("chassis"))
+    {
+        auto& chassis = thread->neuroConfig.chassis;
+        chassis.mode                  = chassisXml->getStringAttribute("mode", "standalone");
+        chassis.ref_clock_terminal    = chassisXml->getStringAttribute("ref_clock_terminal", "");
+        chassis.start_terminal        = chassisXml->getStringAttribute("start_terminal", "");
+        chassis.sync_event_label      = chassisXml->getIntAttribute("sync_event_label", -1);
+        chassis.sync_period_s         = (float) chassisXml->getDoubleAttribute("sync_period_s", 1.0);
+        chassis.sync_tolerance_frames = chassisXml->getIntAttribute("sync_tolerance_frames", 1);
+    }
+
     thread->reloadConfig();
 
     // -----------------------------
@@ -262,10 +615,10 @@ void NeuroLayerEditor::loadCustomParametersFromXml (XmlElement* xml)
             }
         }
 
-        voltageRangeSelector->setSelectedId(
-            voltXml->getIntAttribute("voltage_id", 0),
-            dontSendNotification
-        );
+        const int voltageId = voltXml->getIntAttribute("voltage_id", 0);
+        voltageRangeSelector->setSelectedId(voltageId, dontSendNotification);
+        if (voltageId > 0)
+            thread->setVoltageRange(voltageId - 1);
     }
     else
     {
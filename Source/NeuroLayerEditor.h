@@ -31,7 +31,8 @@
 
 class NeuroLayerEditor : public GenericEditor, 
                          public ComboBox::Listener, 
-                         public Button::Listener
+                         public Button::Listener,
+                         public Timer
 {
 public:
     /** The class constructor, used to initialize any members. */
@@ -46,6 +47,11 @@ public:
     void saveCustomParametersToXml(XmlElement *xml) override;
     void loadCustomParametersFromXml(XmlElement *xml) override;
 
+    /** Polls the settling calibration measured on the first block */
+    void startAcquisition() override;
+    void stopAcquisition() override;
+    void timerCallback() override;
+
 private:
     NeuroLayerThread* thread = nullptr;
 
@@ -53,6 +59,7 @@ private:
     ScopedPointer<juce::Label> voltageLabel;
     ScopedPointer<juce::TextButton> configFileButton;
     ScopedPointer <juce::Label> configFileLabel;
+    ScopedPointer<juce::Label> settlingLabel;
 
     juce::File configFile;
 
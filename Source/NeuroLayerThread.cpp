@@ -50,6 +50,19 @@ bool NeuroLayerThread::foundInputSource()
     return true;
 }
 
+Array<NeuroProcessor*> NeuroLayerThread::getProcessors()
+{
+    Array<NeuroProcessor*> processors;
+
+    if (processor)
+        processors.add (processor.get());
+
+    for (auto* follower : followers)
+        processors.add (follower);
+
+    return processors;
+}
+
 void NeuroLayerThread::updateSettings (OwnedArray<ContinuousChannel>* continuousChannels,
                                  OwnedArray<EventChannel>* eventChannels,
                                  OwnedArray<SpikeChannel>* spikeChannels,
@@ -71,18 +84,42 @@ void NeuroLayerThread::updateSettings (OwnedArray<ContinuousChannel>* continuous
         };
 
         sourceStreams.add (new DataStream (settings));
+        sourceStreams.getLast()->setName ("NeuroLayer");
     }
-    else
+
+    // One stream per probe system (or per group of its column modules), all on the chassis frame clock
+    std::vector<std::pair<NeuroProcessor*, int>> streamSources;
+
+    for (auto* system : getProcessors())
     {
+        // Modules clocked faster than the frame clock average more samples per cell
+        double minCellRate = system->getCellRate (0), maxCellRate = minCellRate;
+        for (int module = 1; module < system->AIdevices.size(); module++)
+        {
+            minCellRate = jmin (minCellRate, system->getCellRate (module));
+            maxCellRate = jmax (maxCellRate, system->getCellRate (module));
+        }
+
+        String cellRate = String (minCellRate, 0);
+        if (maxCellRate > minCellRate)
+            cellRate += " to " + String (maxCellRate, 0);
+
         DataStream::Settings settings {
             "PXI",
-            "Analog input channels from a NIDAQ device",
+            "Analog input channels from a NIDAQ device, " + String (system->getOversampling())
+                + " sample(s) averaged per row (" + String (system->getOversampling() * 1.0e6 / system->getSampleRate(), 2)
+                + " us dwell), effective per-cell rate " + cellRate + " S/s",
             "identifier",
-            processor->getSampleRate() / processor->getRowNumber()
+            float (system->getFrameRate())
 
         };
 
-        sourceStreams.add (new DataStream (settings));
+        for (int stream = 0; stream < system->getStreamCount(); stream++)
+        {
+            sourceStreams.add (new DataStream (settings));
+            sourceStreams.getLast()->setName (system->getStreamName (stream));
+            streamSources.emplace_back (system, stream);
+        }
     }
 
     dataStreams->clear();
@@ -92,21 +129,24 @@ void NeuroLayerThread::updateSettings (OwnedArray<ContinuousChannel>* continuous
     devices->clear();
     configurationObjects->clear();
 
-     DataStream* currentStream = sourceStreams[0];
-
-        currentStream->setName ("NeuroLayer");
+    for (int stream = 0; stream < sourceStreams.size(); stream++)
+    {
+        DataStream* currentStream = sourceStreams[stream];
+        NeuroProcessor* system = stream < int (streamSources.size()) ? streamSources[stream].first : nullptr;
 
         currentStream->clearChannels();
 
-        if (processor)
+        if (system != nullptr)
         {
-            for (int ch = 0; ch < processor->getCellNumber(); ch++)
+            const int systemStream = streamSources[stream].second;
+
+            for (int ch = 0; ch < system->getStreamChannelCount (systemStream); ch++)
             {
-                float bitVolts = processor->getVoltageRange() / float (0x7fff);
+                float bitVolts = getBitVolts (system);
 
                 ContinuousChannel::Settings settings {
                     ContinuousChannel::Type::ADC,
-                    "C" + String (ch / processor->getColumnNumber()) + ",R" + String (ch % processor->getRowNumber()),
+                    system->getStreamChannelName (systemStream, ch),
                     "Electrode",
                     "identifier",
                     bitVolts,
@@ -128,7 +168,7 @@ void NeuroLayerThread::updateSettings (OwnedArray<ContinuousChannel>* continuous
 
         eventChannels->add (new EventChannel (settings));
         dataStreams->add (new DataStream (*currentStream)); // copy existing stream
-    
+    }
 }
 
 bool NeuroLayerThread::startAcquisition()
@@ -136,15 +176,62 @@ bool NeuroLayerThread::startAcquisition()
     if (! processor)
         return false;
 
+    drivenByUpdateBuffer = neuroConfig.acquisition.mode == "update_buffer";
+
+    // Followers wait on the chassis trigger lines, so they are armed before system 0 starts the clock
+    for (int i = 0; i < followers.size(); i++)
+    {
+        if (! followers[i]->arm())
+        {
+            for (int j = 0; j < i; j++)
+                followers[j]->stopAcquisition();
+            return false;
+        }
+    }
+
+    if (drivenByUpdateBuffer)
+    {
+        // Tasks are started here, the reads happen in updateBuffer() on the DataThread
+        if (! processor->startAcquisition())
+        {
+            for (auto* follower : followers)
+                follower->stopAcquisition();
+            return false;
+        }
+
+        startThread();
+        return true;
+    }
+
     processor->startThread();
+
+    for (auto* follower : followers)
+        follower->startThread();
+
     return true;
 }
 
+bool NeuroLayerThread::isAcquiring()
+{
+    for (auto* system : getProcessors())
+    {
+        if (system->isAcquiring() || system->isThreadRunning())
+            return true;
+    }
+
+    return false;
+}
+
 bool NeuroLayerThread::updateBuffer()
 {
+    if (! drivenByUpdateBuffer || ! processor)
+        return true;
 
+    bool ok = true;
+    for (auto* system : getProcessors())
+        ok = system->pollBlock() && ok;
 
-    return true;
+    return ok;
 }
 
 bool NeuroLayerThread::stopAcquisition()
@@ -152,9 +239,43 @@ bool NeuroLayerThread::stopAcquisition()
     if (! processor)
         return false;
 
-    if (processor->isThreadRunning())
+    auto processors = getProcessors();
+
+    for (auto* system : processors)
+        system->requestStop();
+
+    if (drivenByUpdateBuffer)
+    {
+        if (isThreadRunning())
+            signalThreadShouldExit();
+
+        waitForThreadToExit (2000);
+
+        for (auto* system : processors)
+        {
+            system->stopAcquisition();
+            system->writeCalibration();
+        }
+        return true;
+    }
+
+    for (auto* system : processors)
+    {
+        if (system->isThreadRunning())
+            system->signalThreadShouldExit();
+    }
+
+    // The processor threads stop their tasks themselves; the files are written here, off their thread
+    for (auto* system : processors)
     {
-        processor->signalThreadShouldExit();
+        if (system->waitForThreadToExit (2000))
+        {
+            system->writeCalibration();
+        }
+        else
+        {
+            LOGE (system->getSystemName(), " did not stop, its calibration is not written");
+        }
     }
     return true;
 }
@@ -172,6 +293,20 @@ std::unique_ptr<GenericEditor> NeuroLayerThread::createEditor (SourceNode* sn)
 
 void NeuroLayerThread::handleBroadcastMessage (const String& msg, const int64 messageTimestmpMilliseconds)
 {
+    // "NEUROLAYER ROI <set> [<system>]" switches the scanned row set during acquisition,
+    // on system 0 unless another probe system is given
+    StringArray tokens = StringArray::fromTokens (msg, " ", "");
+    tokens.removeEmptyStrings();
+
+    if ((tokens.size() == 3 || tokens.size() == 4) && tokens[0].equalsIgnoreCase ("NEUROLAYER") && tokens[1].equalsIgnoreCase ("ROI"))
+    {
+        NeuroProcessor* system = getProcessors()[tokens[3].getIntValue()];
+
+        if (system != nullptr && system->getRoiSetCount() > 1)
+            system->requestRoi (tokens[2].getIntValue());
+        else
+            LOGC ("No alternative ROI sets configured");
+    }
 }
 
 String NeuroLayerThread::handleConfigMessage (const String& msg)
@@ -187,13 +322,34 @@ void NeuroLayerThread::parameterValueChanged (Parameter* parameter)
 {
 }
 
-void NeuroLayerThread::setVoltageRange (int id)
+float NeuroLayerThread::getBitVolts (NeuroProcessor* system)
+{
+    return system->getVoltageRange() / float (0x7fff);
+}
+
+bool NeuroLayerThread::setVoltageRange (int index)
 {
     if (! processor)
-        return; // nothing to configure yet
+        return false; // nothing to configure yet
 
-    processor->setVoltageRange (id);
-    sourceStreams.clear();
+    if (isAcquiring())
+        return false;
+
+    if (index == processor->getVoltageRangeIndex())
+        return false;
+
+    // Reconfigures the existing AI tasks in place; the editor then updates the signal chain for the new bitVolts
+    for (auto* system : getProcessors())
+        system->setVoltageRange (index);
+    return index == processor->getVoltageRangeIndex();
+}
+
+int NeuroLayerThread::getVoltageRangeIndex()
+{
+    if (! processor)
+        return 0;
+
+    return processor->getVoltageRangeIndex();
 }
 
 
@@ -207,6 +363,14 @@ Array<float> NeuroLayerThread::getVoltageRange()
 
 }
 
+std::vector<SettlingCalibration> NeuroLayerThread::getSettlingCalibration()
+{
+    if (! processor)
+        return {};
+
+    return processor->getSettlingCalibration();
+}
+
 void NeuroLayerThread::setConfigFile (File config)
 {
     LOGD ("Config file updated: " + config.getFullPathName());
@@ -218,9 +382,72 @@ void NeuroLayerThread::setConfigFile (File config)
 
 void NeuroLayerThread::reloadConfig()
 {
+    // The update_buffer mode reads on the DataThread, so the processor threads alone do not tell
+    if (isAcquiring())
+    {
+        LOGC ("Cannot reload the NeuroLayer config during acquisition");
+        return;
+    }
+
+    // Nothing to do if the config did not change since the last reload
+    if (processor && currentConfig.has_value() && *currentConfig == neuroConfig)
+        return;
+
+    if (! processor)
+        processor = std::make_unique<NeuroProcessor> (neuroConfig);
+    else
+        processor->updateConfig (neuroConfig);
+
+    // Additional probe systems run on the frame clock of system 0
+    while (followers.size() > neuroConfig.additionalSystems.size())
+        followers.removeLast();
+
+    for (int i = 0; i < neuroConfig.additionalSystems.size(); i++)
+    {
+        if (i < followers.size())
+            followers[i]->updateConfig (neuroConfig, processor->getSampleRate());
+        else
+            followers.add (new NeuroProcessor (neuroConfig, i + 1, processor->getSampleRate()));
+    }
+
+    // Keep one buffer per stream across reloads, only resized when its channel count or the
+    // required depth (block size, frame rate, headroom) changes
+    int buffer = 0;
+
+    for (auto* system : getProcessors())
+    {
+        const int frames = system->getBufferFrames();
+
+        system->aiBuffers.clear();
+        system->aiBufferFrames = frames;
 
-    processor = std::make_unique<NeuroProcessor> (neuroConfig);
-    sourceBuffers.add (new DataBuffer (processor->getCellNumber(), 10000));
-    processor->aiBuffer = sourceBuffers.getLast();
+        for (int stream = 0; stream < system->getStreamCount(); stream++, buffer++)
+        {
+            const int channels = system->getStreamChannelCount (stream);
+
+            if (buffer >= sourceBuffers.size())
+            {
+                sourceBuffers.add (new DataBuffer (channels, frames));
+                bufferChannels.add (channels);
+                bufferFrames.add (frames);
+            }
+            else if (channels != bufferChannels[buffer] || frames != bufferFrames[buffer])
+            {
+                sourceBuffers[buffer]->resize (channels, frames);
+                bufferChannels.set (buffer, channels);
+                bufferFrames.set (buffer, frames);
+            }
+
+            system->aiBuffers.push_back (sourceBuffers[buffer]);
+        }
+    }
+
+    while (sourceBuffers.size() > buffer)
+        sourceBuffers.removeLast();
+
+    bufferChannels.resize (buffer);
+    bufferFrames.resize (buffer);
+
+    currentConfig = neuroConfig;
     sourceStreams.clear();
-}
\ No newline at end of file
+}
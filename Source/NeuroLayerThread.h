@@ -91,14 +91,29 @@ public:
 
     void setConfigFile(File config);
     void reloadConfig();
-    void setVoltageRange(int value);
+    /** Returns true if the range changed and the channel bitVolts need to be refreshed */
+    bool setVoltageRange(int index);
+    int getVoltageRangeIndex();
     Array<float> getVoltageRange();
+    /** Settling measured on each module at the start of the last acquisition */
+    std::vector<SettlingCalibration> getSettlingCalibration();
     NeuroConfig neuroConfig;
 
 private: 
     juce::File configFile;
     std::unique_ptr<NeuroProcessor> processor;
+    /** Additional probe systems, clocked by processor; each publishes one or more DataStreams */
+    OwnedArray<NeuroProcessor> followers;
     std::optional<NeuroConfig> currentConfig;
+    Array<int> bufferChannels; // per stream, in stream order
+    Array<int> bufferFrames; // per stream, in stream order
+    /** processor then the followers, in stream order */
+    Array<NeuroProcessor*> getProcessors();
+    /** True while any system acquires, in either acquisition mode */
+    bool isAcquiring();
+    float getBitVolts (NeuroProcessor* system);
+    /** True when updateBuffer() performs the reads instead of the NeuroProcessor thread */
+    bool drivenByUpdateBuffer = false;
     OwnedArray<DataStream> sourceStreams;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (NeuroLayerThread);
@@ -0,0 +1,453 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2025 VIB Haesler lab
+ Developed by Marine Guyot - CodingResearcher
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef NEUROSPATIAL_H_DEFINED
+#define NEUROSPATIAL_H_DEFINED
+
+#include <DataThreadHeaders.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/*
+    Spatial stages, applied in place to frame-major blocks of demuxed cells
+    (numCells floats per frame, in output channel order). The processor runs
+    them on chunks of a few frames right after the demux of the chunk, while
+    the cells are still in cache.
+*/
+
+/** Frames per chunk so that a chunk of cells stays within about 64 kB */
+inline int getSpatialChunkFrames (int numCells, int blockFrames)
+{
+    return jlimit (1, jmax (1, blockFrames), 16384 / jmax (1, numCells));
+}
+
+/** Sum of n consecutive cells, with independent partial sums so the loop vectorises */
+inline float sumCells (const float* cells, int n)
+{
+    float partial[8] = {};
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        for (int k = 0; k < 8; ++k)
+            partial[k] += cells[i + k];
+    }
+
+    float sum = 0;
+    for (; i < n; ++i)
+        sum += cells[i];
+    for (int k = 0; k < 8; ++k)
+        sum += partial[k];
+
+    return sum;
+}
+
+/** Runs (first channel, count) of consecutive channels of an ascending channel list */
+inline std::vector<std::pair<int, int>> makeChannelRuns (const std::vector<int>& channels)
+{
+    std::vector<std::pair<int, int>> runs;
+    for (int ch : channels)
+    {
+        if (! runs.empty() && runs.back().first + runs.back().second == ch)
+            runs.back().second++;
+        else
+            runs.emplace_back (ch, 1);
+    }
+    return runs;
+}
+
+/** Median of n values, reordering them */
+inline float medianInPlace (float* values, int n)
+{
+    float* middle = values + n / 2;
+    std::nth_element (values, middle, values + n);
+
+    if (n % 2 != 0)
+        return *middle;
+
+    // Even count: mean of the two middle values, the lower one is the largest of the first half
+    return 0.5f * (*middle + *std::max_element (values, middle));
+}
+
+/* ================================================================
+   Referencing
+   ================================================================ */
+
+enum class ReferenceMode
+{
+    None,
+    Mean, // common average
+    Median
+};
+
+/** Good cells sharing one reference, as runs of consecutive output channels */
+struct ReferenceGroup
+{
+    std::vector<std::pair<int, int>> runs;
+    int numChannels = 0;
+    int id = 0; // group number given to makeReferencePlan
+};
+
+/**
+    Common reference of one frame layout: each group's mean (or median) over its
+    good cells is subtracted from those cells. Bad cells are left out of the groups,
+    so they neither contribute to a reference nor get one subtracted.
+
+    Grouping the cells by probe row gives the row fixed-pattern removal: the cells
+    of a row share the row line of the scan, so anything common to them shows up
+    as a stripe. In column-major order the cells of a row are numRows apart, so
+    every run would be a single cell; makeRowReferencePlan then sets up the grid
+    fields and the kernel works on whole columns at once instead.
+*/
+struct ReferencePlan
+{
+    ReferenceMode mode = ReferenceMode::None;
+    int numCells = 0;
+    std::vector<ReferenceGroup> groups;
+    int maxGroupChannels = 0; // size of the median scratch
+    int numGroupIds = 0; // references per frame written to the removed output of applyReference
+
+    // Row groups of a column-major frame (cell column * gridRows + row), gridRows = 0 otherwise
+    int gridRows = 0;
+    int gridColumns = 0;
+    std::vector<float> mask; // per cell, 1 when the cell belongs to its row's group
+    std::vector<float> rowScale; // 1 / good cells of each row, 0 for rows without a group
+
+    /** Floats of scratch needed by applyReference */
+    int getScratchSize() const { return mode == ReferenceMode::None ? 0 : gridRows + maxGroupChannels; }
+};
+
+/** Builds a plan from the group of each output channel (-1 for bad cells).
+    numGroupIds sets the layout of the removed output, at least one past the largest group. */
+inline ReferencePlan makeReferencePlan (ReferenceMode mode, const std::vector<int>& channelGroup, int numGroupIds = 0)
+{
+    ReferencePlan plan;
+    plan.mode = mode;
+    plan.numCells = int (channelGroup.size());
+
+    if (mode == ReferenceMode::None)
+        return plan;
+
+    std::vector<std::vector<int>> channels (jmax (0, numGroupIds));
+    for (int ch = 0; ch < plan.numCells; ++ch)
+    {
+        if (channelGroup[ch] < 0)
+            continue;
+
+        if (channelGroup[ch] >= int (channels.size()))
+            channels.resize (channelGroup[ch] + 1);
+        channels[channelGroup[ch]].push_back (ch);
+    }
+
+    plan.numGroupIds = int (channels.size());
+
+    for (int id = 0; id < plan.numGroupIds; ++id)
+    {
+        const auto& group = channels[id];
+
+        // A single cell would be referenced to itself
+        if (group.size() < 2)
+            continue;
+
+        plan.groups.push_back ({ makeChannelRuns (group), int (group.size()), id });
+        plan.maxGroupChannels = jmax (plan.maxGroupChannels, int (group.size()));
+    }
+
+    return plan;
+}
+
+/** Builds a plan grouping the cells by row. rowGroup is the row of each output channel (-1 for bad
+    cells); in column-major order, where it must be channel % numRows, the grid kernel is used. */
+inline ReferencePlan makeRowReferencePlan (ReferenceMode mode, int numColumns, int numRows, bool columnMajor,
+                                           const std::vector<int>& rowGroup)
+{
+    ReferencePlan plan = makeReferencePlan (mode, rowGroup, numRows);
+
+    if (mode == ReferenceMode::None || ! columnMajor)
+        return plan;
+
+    plan.gridRows = numRows;
+    plan.gridColumns = numColumns;
+    plan.mask.assign (plan.numCells, 0.0f);
+    plan.rowScale.assign (numRows, 0.0f);
+
+    for (const auto& group : plan.groups)
+    {
+        for (const auto& run : group.runs)
+            std::fill (plan.mask.begin() + run.first, plan.mask.begin() + run.first + run.second, 1.0f);
+        plan.rowScale[group.id] = 1.0f / float (group.numChannels);
+    }
+
+    return plan;
+}
+
+/** Row reference of column-major frames: the rows are accumulated column by column into one
+    value per row, then subtracted in a second pass over the columns, both contiguous */
+inline void applyGridReference (const ReferencePlan& plan, float* block, int numFrames, float* scratch, float* removed)
+{
+    const int numRows = plan.gridRows;
+    float* rowValue = scratch;
+    float* values = scratch + numRows; // median only
+
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+        float* cells = block + size_t (frame) * plan.numCells;
+
+        if (plan.mode == ReferenceMode::Mean)
+        {
+            std::fill (rowValue, rowValue + numRows, 0.0f);
+
+            for (int column = 0; column < plan.gridColumns; ++column)
+            {
+                const float* src = cells + column * numRows;
+                const float* mask = plan.mask.data() + column * numRows;
+                for (int row = 0; row < numRows; ++row)
+                    rowValue[row] += src[row] * mask[row];
+            }
+
+            for (int row = 0; row < numRows; ++row)
+                rowValue[row] *= plan.rowScale[row];
+        }
+        else
+        {
+            std::fill (rowValue, rowValue + numRows, 0.0f);
+
+            for (const auto& group : plan.groups)
+            {
+                float* end = values;
+                for (const auto& run : group.runs)
+                    end = std::copy (cells + run.first, cells + run.first + run.second, end);
+                rowValue[group.id] = medianInPlace (values, group.numChannels);
+            }
+        }
+
+        for (int column = 0; column < plan.gridColumns; ++column)
+        {
+            float* dst = cells + column * numRows;
+            const float* mask = plan.mask.data() + column * numRows;
+            for (int row = 0; row < numRows; ++row)
+                dst[row] -= rowValue[row] * mask[row];
+        }
+
+        if (removed != nullptr)
+            std::copy (rowValue, rowValue + numRows, removed + size_t (frame) * numRows);
+    }
+}
+
+/** Subtracts the common reference from numFrames frames; scratch holds getScratchSize() floats.
+    removed, if not null, receives the reference of each group at its id (numGroupIds floats per
+    frame, 0 for ids without a group). */
+inline void applyReference (const ReferencePlan& plan, float* block, int numFrames, float* scratch, float* removed = nullptr)
+{
+    if (plan.mode == ReferenceMode::None)
+        return;
+
+    if (plan.gridRows > 0)
+    {
+        applyGridReference (plan, block, numFrames, scratch, removed);
+        return;
+    }
+
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+        float* cells = block + size_t (frame) * plan.numCells;
+        float* frameRemoved = removed != nullptr ? removed + size_t (frame) * plan.numGroupIds : nullptr;
+
+        if (frameRemoved != nullptr)
+            std::fill (frameRemoved, frameRemoved + plan.numGroupIds, 0.0f);
+
+        for (const auto& group : plan.groups)
+        {
+            float reference = 0;
+
+            if (plan.mode == ReferenceMode::Mean)
+            {
+                for (const auto& run : group.runs)
+                    reference += sumCells (cells + run.first, run.second);
+                reference /= float (group.numChannels);
+            }
+            else
+            {
+                float* values = scratch;
+                for (const auto& run : group.runs)
+                    values = std::copy (cells + run.first, cells + run.first + run.second, values);
+                reference = medianInPlace (scratch, group.numChannels);
+            }
+
+            if (frameRemoved != nullptr)
+                frameRemoved[group.id] = reference;
+
+            for (const auto& run : group.runs)
+            {
+                float* dst = cells + run.first;
+                for (int i = 0; i < run.second; ++i)
+                    dst[i] -= reference;
+            }
+        }
+    }
+}
+
+/* ================================================================
+   Laplacian
+   ================================================================ */
+
+/**
+    5-point stencil over the probe grid: each good cell becomes
+    center * cell + sum of neighbourWeight * neighbour, over its left/right
+    columns and the rows above/below. A neighbour is missing at the grid edges,
+    across a gap in the scanned rows and when it is a bad cell; its weight is
+    then shared among the present neighbours, so the stencil keeps the same
+    total. Bad cells and cells without any good neighbour are left untouched.
+
+    The weights are stored per output channel. In column-major order the
+    neighbours sit at fixed offsets (+-1 row, +-numRows column) and the kernel
+    is one contiguous, vectorisable pass per frame; other orders go through a
+    neighbour table.
+*/
+struct LaplacianPlan
+{
+    bool enabled = false;
+    int numCells = 0;
+    int padding = 1; // zero cells before and after the frame copy, covers the column-major offsets
+    bool columnMajor = true;
+    int numRows = 0;
+    std::vector<float> center; // per output channel
+    std::vector<float> neighbourWeight[4]; // left, right, up, down, per output channel
+    std::vector<int> neighbour; // 4 per output channel, -1 when missing (other orders only)
+
+    /** Floats of scratch needed by applyLaplacian */
+    int getScratchSize() const { return enabled ? numCells + 2 * padding : 0; }
+};
+
+/** Builds the stencil. cellChannel and badCells are indexed column * numRows + cell row, rowAdjacent[row]
+    tells whether cell rows row and row + 1 are neighbours on the probe. weights are
+    (center, left/right column neighbour, upper/lower row neighbour). */
+inline LaplacianPlan makeLaplacianPlan (int numColumns, int numRows, bool columnMajor,
+                                        const std::vector<int>& cellChannel, const std::vector<bool>& badCells,
+                                        const std::vector<bool>& rowAdjacent, const std::vector<float>& weights)
+{
+    LaplacianPlan plan;
+    plan.enabled = weights.size() == 3;
+    plan.numCells = numColumns * numRows;
+    plan.numRows = numRows;
+    plan.padding = jmax (1, numRows);
+    plan.columnMajor = columnMajor;
+
+    if (! plan.enabled)
+        return plan;
+
+    plan.center.assign (plan.numCells, 1.0f);
+    for (auto& weight : plan.neighbourWeight)
+        weight.assign (plan.numCells, 0.0f);
+    plan.neighbour.assign (columnMajor ? 0 : size_t (plan.numCells) * 4, -1);
+
+    const float stencilWeight[4] = { weights[1], weights[1], weights[2], weights[2] };
+    const float totalWeight = 2 * weights[1] + 2 * weights[2];
+
+    for (int column = 0; column < numColumns; ++column)
+    {
+        for (int row = 0; row < numRows; ++row)
+        {
+            const int cell = column * numRows + row;
+            const int ch = cellChannel[cell];
+
+            if (badCells[cell])
+                continue;
+
+            const bool present[4] = {
+                column > 0 && ! badCells[cell - numRows],
+                column + 1 < numColumns && ! badCells[cell + numRows],
+                row > 0 && rowAdjacent[row - 1] && ! badCells[cell - 1],
+                row + 1 < numRows && rowAdjacent[row] && ! badCells[cell + 1]
+            };
+            const int neighbourCell[4] = { cell - numRows, cell + numRows, cell - 1, cell + 1 };
+
+            float presentWeight = 0;
+            for (int k = 0; k < 4; ++k)
+                presentWeight += present[k] ? stencilWeight[k] : 0.0f;
+
+            if (presentWeight == 0)
+                continue;
+
+            plan.center[ch] = weights[0];
+            for (int k = 0; k < 4; ++k)
+            {
+                if (! present[k])
+                    continue;
+
+                plan.neighbourWeight[k][ch] = stencilWeight[k] * totalWeight / presentWeight;
+                if (! columnMajor)
+                    plan.neighbour[size_t (ch) * 4 + k] = cellChannel[neighbourCell[k]];
+            }
+        }
+    }
+
+    return plan;
+}
+
+/** Applies the stencil in place to numFrames frames; scratch holds getScratchSize() floats */
+inline void applyLaplacian (const LaplacianPlan& plan, float* block, int numFrames, float* scratch)
+{
+    if (! plan.enabled)
+        return;
+
+    // Each frame is copied between zero pads, so the edge offsets stay in bounds (their weight is 0)
+    float* src = scratch + plan.padding;
+    std::fill (scratch, src, 0.0f);
+    std::fill (src + plan.numCells, src + plan.numCells + plan.padding, 0.0f);
+
+    const float* center = plan.center.data();
+    const float* left = plan.neighbourWeight[0].data();
+    const float* right = plan.neighbourWeight[1].data();
+    const float* up = plan.neighbourWeight[2].data();
+    const float* down = plan.neighbourWeight[3].data();
+
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+        float* cells = block + size_t (frame) * plan.numCells;
+        std::copy (cells, cells + plan.numCells, src);
+
+        if (plan.columnMajor)
+        {
+            const int numRows = plan.numRows;
+            for (int ch = 0; ch < plan.numCells; ++ch)
+            {
+                cells[ch] = center[ch] * src[ch] + left[ch] * src[ch - numRows] + right[ch] * src[ch + numRows]
+                            + up[ch] * src[ch - 1] + down[ch] * src[ch + 1];
+            }
+        }
+        else
+        {
+            const int* neighbour = plan.neighbour.data();
+            for (int ch = 0; ch < plan.numCells; ++ch, neighbour += 4)
+            {
+                cells[ch] = center[ch] * src[ch] + left[ch] * src[neighbour[0]] + right[ch] * src[neighbour[1]]
+                            + up[ch] * src[neighbour[2]] + down[ch] * src[neighbour[3]];
+            }
+        }
+    }
+}
+
+#endif
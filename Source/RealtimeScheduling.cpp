@@ -0,0 +1,174 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2025 VIB Haesler lab
+ Developed by Marine Guyot - CodingResearcher
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "RealtimeScheduling.h"
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+void Realtime::applyPriority (const RealtimeConfig& cfg, RealtimeStatus& status)
+{
+    if (cfg.thread_priority == "normal")
+    {
+        status.priority = "normal";
+        status.priorityApplied = true;
+        return;
+    }
+
+    const bool realtime = cfg.thread_priority == "realtime";
+
+#ifdef WIN32
+    int priority = realtime ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+    if (SetThreadPriority (GetCurrentThread(), priority))
+    {
+        status.priority = realtime ? "time critical" : "highest";
+        status.priorityApplied = true;
+    }
+    else
+    {
+        status.priority = "failed (error " + String ((int) GetLastError()) + ")";
+    }
+#else
+    if (realtime)
+    {
+        sched_param param {};
+        param.sched_priority = jlimit (sched_get_priority_min (SCHED_FIFO),
+                                       sched_get_priority_max (SCHED_FIFO),
+                                       cfg.rt_priority);
+
+        int error = pthread_setschedparam (pthread_self(), SCHED_FIFO, &param);
+        if (error == 0)
+        {
+            status.priority = "SCHED_FIFO " + String (param.sched_priority);
+            status.priorityApplied = true;
+            return;
+        }
+
+        // Usually EPERM without CAP_SYS_NICE or an rtprio limit, try the best non real-time priority
+        status.priority = "SCHED_FIFO failed (" + String (strerror (error)) + "), ";
+    }
+
+    // Linux threads have their own nice value
+    if (setpriority (PRIO_PROCESS, 0, -20) == 0)
+    {
+        status.priority += "nice -20";
+        status.priorityApplied = ! realtime;
+    }
+    else
+    {
+        status.priority += "nice failed (" + String (strerror (errno)) + ")";
+    }
+#endif
+}
+
+void Realtime::applyAffinity (const RealtimeConfig& cfg, RealtimeStatus& status)
+{
+    if (cfg.cpu_affinity.isEmpty())
+    {
+        status.affinity = "any CPU";
+        status.affinityApplied = true;
+        return;
+    }
+
+    String cpuList;
+    for (int cpu : cfg.cpu_affinity)
+        cpuList += (cpuList.isEmpty() ? "" : ",") + String (cpu);
+
+#ifdef WIN32
+    DWORD_PTR mask = 0;
+    for (int cpu : cfg.cpu_affinity)
+    {
+        if (isPositiveAndBelow (cpu, int (sizeof (DWORD_PTR) * 8)))
+            mask |= DWORD_PTR (1) << cpu;
+    }
+
+    if (mask != 0 && SetThreadAffinityMask (GetCurrentThread(), mask) != 0)
+    {
+        status.affinity = "CPU " + cpuList;
+        status.affinityApplied = true;
+    }
+    else
+    {
+        status.affinity = "failed for CPU " + cpuList;
+    }
+#else
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    for (int cpu : cfg.cpu_affinity)
+    {
+        if (isPositiveAndBelow (cpu, CPU_SETSIZE))
+            CPU_SET (cpu, &set);
+    }
+
+    int error = pthread_setaffinity_np (pthread_self(), sizeof (set), &set);
+    if (error == 0)
+    {
+        status.affinity = "CPU " + cpuList;
+        status.affinityApplied = true;
+    }
+    else
+    {
+        status.affinity = "failed for CPU " + cpuList + " (" + String (strerror (error)) + ")";
+    }
+#endif
+}
+
+bool Realtime::lockMemory (const void* data, size_t numBytes)
+{
+    if (data == nullptr || numBytes == 0)
+        return true;
+
+#ifdef WIN32
+    // VirtualLock is limited by the working set size, grow it to make room for the region
+    SIZE_T minSize = 0, maxSize = 0;
+    HANDLE process = GetCurrentProcess();
+    if (GetProcessWorkingSetSize (process, &minSize, &maxSize))
+        SetProcessWorkingSetSize (process, minSize + numBytes, jmax (maxSize, minSize + numBytes));
+
+    return VirtualLock (const_cast<void*> (data), numBytes) != 0;
+#else
+    return mlock (data, numBytes) == 0;
+#endif
+}
+
+void Realtime::unlockMemory (const void* data, size_t numBytes)
+{
+    if (data == nullptr || numBytes == 0)
+        return;
+
+#ifdef WIN32
+    VirtualUnlock (const_cast<void*> (data), numBytes);
+#else
+    munlock (data, numBytes);
+#endif
+}
@@ -0,0 +1,59 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2025 VIB Haesler lab
+ Developed by Marine Guyot - CodingResearcher
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef REALTIMESCHEDULING_H_DEFINED
+#define REALTIMESCHEDULING_H_DEFINED
+
+#include <DataThreadHeaders.h>
+#include "NeuroConfig.h"
+
+/** Outcome of applying a RealtimeConfig to the acquisition thread */
+struct RealtimeStatus
+{
+    String priority = "not applied";
+    String affinity = "not applied";
+    String memoryLock = "not applied";
+    bool priorityApplied = false;
+    bool affinityApplied = false;
+    bool memoryLocked = false;
+};
+
+namespace Realtime
+{
+    /** Raises the priority of the calling thread.
+        "realtime" uses SCHED_FIFO on Linux and falls back to the highest normal priority;
+        on Windows it maps to THREAD_PRIORITY_TIME_CRITICAL. */
+    void applyPriority (const RealtimeConfig& cfg, RealtimeStatus& status);
+
+    /** Pins the calling thread to the configured CPUs */
+    void applyAffinity (const RealtimeConfig& cfg, RealtimeStatus& status);
+
+    /** Locks a memory region in RAM so the acquisition loop never page-faults on it */
+    bool lockMemory (const void* data, size_t numBytes);
+
+    /** Releases a region previously locked with lockMemory */
+    void unlockMemory (const void* data, size_t numBytes);
+}
+
+#endif